@@ -8,31 +8,151 @@
 #include <vector>
 #include <string>
 #include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "inputbuf.h"
 
 using namespace std;
 
+static const size_t READ_BLOCK = 1 << 20;
+
+InputBuffer::InputBuffer(Mode mode)
+{
+    if (mode == STREAM)
+        return;
+    if (mode != BLOCK && MapFd(STDIN_FILENO))
+        return;
+    if (mode != AUTO)
+        ReadFd(STDIN_FILENO, "stdin");
+    // AUTO on a pipe or terminal falls back to cin
+}
+
+InputBuffer::InputBuffer(const char* path, Mode mode)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        throw runtime_error(string("InputBuffer: cannot open ") + path);
+    try {
+        if (mode == BLOCK || !MapFd(fd))
+            ReadFd(fd, path);
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+}
+
+InputBuffer::InputBuffer(const char* data, size_t len)
+{
+    SetSpan(data, len, 0);
+}
+
+InputBuffer::~InputBuffer()
+{
+    if (map_addr != nullptr)
+        munmap(map_addr, map_len);
+}
+
+void InputBuffer::SetSpan(const char* data, size_t len, size_t start)
+{
+    has_span = true;
+    span = data;
+    span_len = len;
+    cursor = start;
+}
+
+// Maps a regular file; the span starts at the descriptor's current offset
+// so that a partially consumed stdin is honoured.
+bool InputBuffer::MapFd(int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+        return false;
+    off_t start = lseek(fd, 0, SEEK_CUR);
+    if (start < 0 || start > st.st_size)
+        start = 0;
+    if (st.st_size == 0) {
+        SetSpan("", 0, 0);
+        return true;
+    }
+    void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED)
+        return false;
+    madvise(addr, st.st_size, MADV_SEQUENTIAL);
+    map_addr = addr;
+    map_len = st.st_size;
+    SetSpan((const char*) addr, st.st_size, start);
+    return true;
+}
+
+// Reads until end of file; an interrupted read is retried so that a
+// signal cannot cut the program short.
+void InputBuffer::ReadFd(int fd, const char* name)
+{
+    size_t used = 0;
+    for (;;) {
+        owned.resize(used + READ_BLOCK);
+        ssize_t n = read(fd, owned.data() + used, READ_BLOCK);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            throw runtime_error(string("InputBuffer: cannot read ") + name + ": " + strerror(errno));
+        if (n == 0)
+            break;
+        used += n;
+    }
+    owned.resize(used);
+    SetSpan(owned.data(), used, 0);
+}
+
+void InputBuffer::SetPos(size_t pos)
+{
+    input_buffer.clear();
+    cursor = pos < span_len ? pos : span_len;
+    past_end = false;
+}
+
 bool InputBuffer::EndOfInput()
 {
     if (!input_buffer.empty())
         return false;
+    else if (has_span)
+        return past_end && cursor >= span_len;
     else
         return cin.eof();
 }
 
+// In span mode the character just read is given back by moving the cursor;
+// anything else goes on the push back stack.
 char InputBuffer::UngetChar(char c)
 {
-    if (c != EOF)
-        input_buffer.push_back(c);;
+    if (c == EOF)
+        return c;
+    if (has_span && input_buffer.empty() && cursor > 0 && span[cursor-1] == c)
+        cursor--;
+    else
+        input_buffer.push_back(c);
     return c;
 }
 
+// Like cin.get(), reading past the end leaves c unchanged.
 void InputBuffer::GetChar(char& c)
 {
     if (!input_buffer.empty()) {
         c = input_buffer.back();
         input_buffer.pop_back();
+    } else if (has_span) {
+        if (cursor < span_len)
+            c = span[cursor++];
+        else
+            past_end = true;
     } else {
         cin.get(c);
     }
@@ -40,7 +160,12 @@ void InputBuffer::GetChar(char& c)
 
 string InputBuffer::UngetString(string s)
 {
-    for (int i = 0; i < s.size(); i++)
+    if (has_span && input_buffer.empty() && s.size() <= cursor &&
+        memcmp(span + cursor - s.size(), s.data(), s.size()) == 0) {
+        cursor -= s.size();
+        return s;
+    }
+    for (size_t i = 0; i < s.size(); i++)
         input_buffer.push_back(s[s.size()-i-1]);
     return s;
 }
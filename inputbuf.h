@@ -6,18 +6,61 @@
 #ifndef __INPUT_BUFFER__H__
 #define __INPUT_BUFFER__H__
 
+#include <cstddef>
 #include <string>
 #include <vector>
 
+// An InputBuffer either streams characters from cin or, when the whole
+// input is available up front, hands out a contiguous span with a cursor.
+// In span mode GetChar is a pointer bump and UngetChar moves the cursor
+// back, so no per-character iostream calls are made.
 class InputBuffer {
   public:
+    typedef enum { AUTO, MAP, BLOCK, STREAM } Mode;
+
+    // stdin: AUTO maps regular files and streams everything else through
+    // cin; BLOCK reads stdin with large read() calls. Throws
+    // std::runtime_error if stdin cannot be read.
+    explicit InputBuffer(Mode mode = AUTO);
+    // a file on disk: AUTO and MAP map it (or block read it if it cannot be
+    // mapped), BLOCK always reads it; STREAM is not accepted for a path.
+    // Throws std::runtime_error if it cannot be opened or read
+    InputBuffer(const char* path, Mode mode);
+    // a caller-owned buffer that must outlive the InputBuffer
+    InputBuffer(const char* data, size_t len);
+    ~InputBuffer();
+
+    InputBuffer(const InputBuffer&) = delete;
+    InputBuffer& operator=(const InputBuffer&) = delete;
+
     void GetChar(char&);
     char UngetChar(char);
     std::string UngetString(std::string);
     bool EndOfInput();
 
+    // span access, only meaningful when HasSpan() is true
+    bool HasSpan() const { return has_span; }
+    const char* Data() const { return span; }
+    size_t Size() const { return span_len; }
+    size_t Pos() const { return cursor; }
+    void SetPos(size_t pos);
+
   private:
-    std::vector<char> input_buffer;
+    std::vector<char> input_buffer;     // pushed back characters
+
+    bool has_span = false;
+    const char* span = nullptr;
+    size_t span_len = 0;
+    size_t cursor = 0;
+    bool past_end = false;              // a read was attempted at the end
+
+    void* map_addr = nullptr;
+    size_t map_len = 0;
+    std::vector<char> owned;            // storage for BLOCK mode
+
+    bool MapFd(int fd);
+    void ReadFd(int fd, const char* name);
+    void SetSpan(const char* data, size_t len, size_t start);
 };
 
 #endif  //__INPUT_BUFFER__H__
@@ -0,0 +1,35 @@
+#include "intern.h"
+#include <cstring>
+
+using namespace std;
+
+static const size_t CHUNK_SIZE = 64 * 1024;
+
+string_view NameTable::store(string_view s) {
+    if (chunkUsed + s.size() > chunkCap) {
+        size_t cap = s.size() > CHUNK_SIZE ? s.size() : CHUNK_SIZE;
+        chunks.emplace_back(new char[cap]);
+        chunkUsed = 0;
+        chunkCap = cap;
+    }
+    char *dst = chunks.back().get() + chunkUsed;
+    memcpy(dst, s.data(), s.size());
+    chunkUsed += s.size();
+    return string_view(dst, s.size());
+}
+
+int NameTable::intern(string_view s) {
+    auto it = ids.find(s);
+    if (it != ids.end())
+        return it->second;
+    string_view stored = store(s);
+    int id = (int)names.size();
+    names.push_back(stored);
+    ids.emplace(stored, id);
+    return id;
+}
+
+int NameTable::find(string_view s) const {
+    auto it = ids.find(s);
+    return it == ids.end() ? -1 : it->second;
+}
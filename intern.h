@@ -0,0 +1,37 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <memory>
+
+///---------------------------------------------------------
+/// Interned Name Table
+///---------------------------------------------------------
+
+/// Maps each distinct name to a dense integer id. The characters of every
+/// distinct name are copied once into chunked storage owned by the table,
+/// so the returned views stay valid for the table's lifetime.
+class NameTable {
+public:
+    NameTable() = default;
+    NameTable(const NameTable&) = delete;
+    NameTable& operator=(const NameTable&) = delete;
+
+    int intern(std::string_view s);        // Id of s, adding it if new
+    int find(std::string_view s) const;    // Id of s, or -1 if absent
+    std::string_view name(int id) const { return names[id]; }
+    int size() const { return (int)names.size(); }
+
+private:
+    std::unordered_map<std::string_view, int> ids;
+    std::vector<std::string_view> names;   // id -> stored characters
+    std::vector<std::unique_ptr<char[]>> chunks;
+    size_t chunkUsed = 0;
+    size_t chunkCap = 0;
+
+    std::string_view store(std::string_view s);
+};
+
+#endif
@@ -7,7 +7,14 @@
 #include <istream>
 #include <vector>
 #include <string>
+#include <string_view>
+#include <stdexcept>
 #include <cctype>
+#include <climits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 #include "lexer.h"
 #include "inputbuf.h"
@@ -29,20 +36,291 @@ void Token::Print()
          << this->line_no << "}\n";
 }
 
+// Value of a NUM lexeme, with the same result atoi() gives on this platform
+// (strtol saturates at LONG_MAX and the result is narrowed to int).
+int lexemeToInt(string_view s)
+{
+    long v = 0;
+    for (char c : s) {
+        int d = c - '0';
+        if (v > (LONG_MAX - d) / 10) {
+            v = LONG_MAX;
+            break;
+        }
+        v = v * 10 + d;
+    }
+    return (int)v;
+}
+
+__int128 lexemeToLiteral(string_view s)
+{
+    const __int128 max = (__int128)(~(unsigned __int128)0 >> 1);
+    __int128 v = 0;
+    for (char c : s) {
+        int d = c - '0';
+        if (v > (max - d) / 10)
+            return max;
+        v = v * 10 + d;
+    }
+    return v;
+}
+
+// ------- character classes -------------
+//
+// One table lookup classifies a character; the classes match isspace,
+// isdigit and isalpha in the C locale. punct maps single character tokens
+// to their type and everything else to ERROR.
+
+enum { CC_SPACE = 1, CC_DIGIT = 2, CC_ALPHA = 4 };
+
+struct CharClassTable {
+    unsigned char cls[256];
+    TokenType punct[256];
+
+    constexpr CharClassTable() : cls(), punct()
+    {
+        for (int c = 0; c < 256; c++) {
+            punct[c] = ERROR;
+            if (c == ' ' || (c >= '\t' && c <= '\r'))
+                cls[c] = CC_SPACE;
+            else if (c >= '0' && c <= '9')
+                cls[c] = CC_DIGIT;
+            else if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
+                cls[c] = CC_ALPHA;
+        }
+        punct[(int) ';'] = SEMICOLON;
+        punct[(int) '^'] = POWER;
+        punct[(int) '-'] = MINUS;
+        punct[(int) '+'] = PLUS;
+        punct[(int) '='] = EQUAL;
+        punct[(int) '('] = LPAREN;
+        punct[(int) ')'] = RPAREN;
+        punct[(int) ','] = COMMA;
+    }
+};
+
+static constexpr CharClassTable charClass;
+
+static inline bool IsSpaceChar(char c)
+{
+    return charClass.cls[(unsigned char) c] & CC_SPACE;
+}
+
+static inline bool IsDigitChar(char c)
+{
+    return charClass.cls[(unsigned char) c] & CC_DIGIT;
+}
+
+static inline bool IsAlphaChar(char c)
+{
+    return charClass.cls[(unsigned char) c] & CC_ALPHA;
+}
+
+static inline bool IsAlnumChar(char c)
+{
+    return charClass.cls[(unsigned char) c] & (CC_DIGIT | CC_ALPHA);
+}
+
+// ------- run scanners ------------------
+//
+// Each scanner finds the end of a run of whitespace (counting newlines),
+// digits or identifier characters. The vector versions look at 16 or 32
+// bytes per step and finish the tail with the scalar loop.
+
+struct RunScanner {
+    const char* (*skipSpace)(const char*, const char*, int&);
+    const char* (*digitEnd)(const char*, const char*);
+    const char* (*alnumEnd)(const char*, const char*);
+};
+
+static const char* SkipSpaceScalar(const char* p, const char* end, int& lines)
+{
+    while (p < end && IsSpaceChar(*p)) {
+        lines += (*p == '\n');
+        p++;
+    }
+    return p;
+}
+
+static const char* DigitEndScalar(const char* p, const char* end)
+{
+    while (p < end && IsDigitChar(*p))
+        p++;
+    return p;
+}
+
+static const char* AlnumEndScalar(const char* p, const char* end)
+{
+    while (p < end && IsAlnumChar(*p))
+        p++;
+    return p;
+}
+
+static const RunScanner scalarScanner = {
+    SkipSpaceScalar, DigitEndScalar, AlnumEndScalar
+};
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// x in [lo, lo + n] as an unsigned byte compare: min(x - lo, n) == x - lo
+#define BYTE_IN_RANGE(W, x, lo, n) \
+    _mm##W##_cmpeq_epi8(_mm##W##_min_epu8(_mm##W##_sub_epi8(x, _mm##W##_set1_epi8(lo)), \
+                        _mm##W##_set1_epi8(n)), _mm##W##_sub_epi8(x, _mm##W##_set1_epi8(lo)))
+
+static const char* SkipSpaceSSE2(const char* p, const char* end, int& lines)
+{
+    while (end - p >= 16) {
+        __m128i b = _mm_loadu_si128((const __m128i*) p);
+        __m128i ws = _mm_or_si128(BYTE_IN_RANGE(, b, '\t', 4),
+                                  _mm_cmpeq_epi8(b, _mm_set1_epi8(' ')));
+        unsigned wsMask = _mm_movemask_epi8(ws);
+        unsigned nlMask = _mm_movemask_epi8(_mm_cmpeq_epi8(b, _mm_set1_epi8('\n')));
+        if (wsMask != 0xFFFF) {
+            int i = __builtin_ctz(~wsMask);
+            lines += __builtin_popcount(nlMask & ((1u << i) - 1));
+            return p + i;
+        }
+        lines += __builtin_popcount(nlMask);
+        p += 16;
+    }
+    return SkipSpaceScalar(p, end, lines);
+}
+
+static const char* DigitEndSSE2(const char* p, const char* end)
+{
+    while (end - p >= 16) {
+        __m128i b = _mm_loadu_si128((const __m128i*) p);
+        unsigned mask = _mm_movemask_epi8(BYTE_IN_RANGE(, b, '0', 9));
+        if (mask != 0xFFFF)
+            return p + __builtin_ctz(~mask);
+        p += 16;
+    }
+    return DigitEndScalar(p, end);
+}
+
+static const char* AlnumEndSSE2(const char* p, const char* end)
+{
+    while (end - p >= 16) {
+        __m128i b = _mm_loadu_si128((const __m128i*) p);
+        __m128i lower = _mm_or_si128(b, _mm_set1_epi8(0x20));
+        unsigned mask = _mm_movemask_epi8(_mm_or_si128(BYTE_IN_RANGE(, b, '0', 9),
+                                                       BYTE_IN_RANGE(, lower, 'a', 25)));
+        if (mask != 0xFFFF)
+            return p + __builtin_ctz(~mask);
+        p += 16;
+    }
+    return AlnumEndScalar(p, end);
+}
+
+static const RunScanner sse2Scanner = {
+    SkipSpaceSSE2, DigitEndSSE2, AlnumEndSSE2
+};
+
+__attribute__((target("avx2")))
+static const char* SkipSpaceAVX2(const char* p, const char* end, int& lines)
+{
+    while (end - p >= 32) {
+        __m256i b = _mm256_loadu_si256((const __m256i*) p);
+        __m256i ws = _mm256_or_si256(BYTE_IN_RANGE(256, b, '\t', 4),
+                                     _mm256_cmpeq_epi8(b, _mm256_set1_epi8(' ')));
+        unsigned wsMask = _mm256_movemask_epi8(ws);
+        unsigned nlMask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(b, _mm256_set1_epi8('\n')));
+        if (wsMask != 0xFFFFFFFFu) {
+            int i = __builtin_ctz(~wsMask);
+            lines += __builtin_popcount(nlMask & ((1u << i) - 1));
+            return p + i;
+        }
+        lines += __builtin_popcount(nlMask);
+        p += 32;
+    }
+    return SkipSpaceSSE2(p, end, lines);
+}
+
+__attribute__((target("avx2")))
+static const char* DigitEndAVX2(const char* p, const char* end)
+{
+    while (end - p >= 32) {
+        __m256i b = _mm256_loadu_si256((const __m256i*) p);
+        unsigned mask = _mm256_movemask_epi8(BYTE_IN_RANGE(256, b, '0', 9));
+        if (mask != 0xFFFFFFFFu)
+            return p + __builtin_ctz(~mask);
+        p += 32;
+    }
+    return DigitEndSSE2(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char* AlnumEndAVX2(const char* p, const char* end)
+{
+    while (end - p >= 32) {
+        __m256i b = _mm256_loadu_si256((const __m256i*) p);
+        __m256i lower = _mm256_or_si256(b, _mm256_set1_epi8(0x20));
+        unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(BYTE_IN_RANGE(256, b, '0', 9),
+                                                             BYTE_IN_RANGE(256, lower, 'a', 25)));
+        if (mask != 0xFFFFFFFFu)
+            return p + __builtin_ctz(~mask);
+        p += 32;
+    }
+    return AlnumEndSSE2(p, end);
+}
+
+static const RunScanner avx2Scanner = {
+    SkipSpaceAVX2, DigitEndAVX2, AlnumEndAVX2
+};
+
+#endif
+
+// The fastest scanner the CPU supports that does not exceed the request
+static const RunScanner* SelectScanner(ScanMode mode)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if ((mode == SCAN_AUTO || mode == SCAN_AVX2) && __builtin_cpu_supports("avx2"))
+        return &avx2Scanner;
+    if (mode != SCAN_SCALAR)
+        return &sse2Scanner;
+#endif
+    (void) mode;
+    return &scalarScanner;
+}
+
 // The constructor function will get all token in the input and stores them in an
 // internal vector. This faciliates the implementation of peek()
 LexicalAnalyzer::LexicalAnalyzer()
+    : streaming(false), scanner(SelectScanner(SCAN_AUTO)),
+      ownedInput(new InputBuffer()), input(*ownedInput)
+{
+    Tokenize();
+}
+
+// Same, but reads from a caller supplied buffer (a mapped file, a block
+// read of stdin or an in-memory program). In streaming mode nothing is read
+// until the first token is requested.
+LexicalAnalyzer::LexicalAnalyzer(InputBuffer& in, bool streaming, ScanMode scan)
+    : streaming(streaming), scanner(SelectScanner(scan)), input(in)
+{
+    Tokenize();
+}
+
+void LexicalAnalyzer::Tokenize()
 {
     this->line_no = 1;
     tmp.lexeme = "";
     tmp.line_no = 1;
     tmp.token_type = ERROR;
+    tmp.id = -1;
+    index = 0;
+    ringStart = 0;
+    ringCount = 0;
+    inputDone = false;
+    if (streaming)
+        return;
 
     Token token = GetTokenMain();
-    index = 0;
 
     while (token.token_type != END_OF_FILE)
     {
+        if (token.token_type == NUM && !input.HasSpan())
+            token.lexeme = literals.name(literals.intern(token.lexeme));
         tokenList.push_back(token);     // push token into internal list
         token = GetTokenMain();        // and get next token from standatd input
     }
@@ -58,7 +336,7 @@ bool LexicalAnalyzer::SkipSpace()
     input.GetChar(c);
     line_no += (c == '\n');
 
-    while (!input.EndOfInput() && isspace(c)) {
+    while (!input.EndOfInput() && IsSpaceChar(c)) {
         space_encountered = true;
         input.GetChar(c);
         line_no += (c == '\n');
@@ -70,23 +348,17 @@ bool LexicalAnalyzer::SkipSpace()
     return space_encountered;
 }
 
-bool LexicalAnalyzer::IsKeyword(string s)
-{
-    for (int i = 0; i < KEYWORDS_COUNT; i++) {
-        if (s == keyword[i]) {
-            return true;
-        }
-    }
-    return false;
-}
+// Perfect hash over the keywords: (2 * length + last character) mod 8 is
+// distinct for all six, so a lookup is one table probe and one compare.
+static const int keywordSlot[8] = { 4, 0, -1, 3, -1, 2, 1, 5 };
 
-TokenType LexicalAnalyzer::FindKeywordIndex(string s)
+TokenType LexicalAnalyzer::FindKeywordIndex(string_view s)
 {
-    for (int i = 0; i < KEYWORDS_COUNT; i++) {
-        if (s == keyword[i]) {
-            return (TokenType) (i + 1);
-        }
-    }
+    if (s.size() < 4 || s.size() > 7)
+        return ERROR;
+    int i = keywordSlot[(2 * s.size() + (unsigned char) s.back()) & 7];
+    if (i >= 0 && s == keyword[i])
+        return (TokenType) (i + 1);
     return ERROR;
 }
 
@@ -95,19 +367,21 @@ Token LexicalAnalyzer::ScanNumber()
     char c;
 
     input.GetChar(c);
-    if (isdigit(c)) {
+    if (IsDigitChar(c)) {
         if (c == '0') {
             tmp.lexeme = "0";
         } else {
-            tmp.lexeme = "";
-            while (!input.EndOfInput() && isdigit(c)) {
-                tmp.lexeme += c;
+            scratch.clear();
+            while (!input.EndOfInput() && IsDigitChar(c)) {
+                scratch += c;
                 input.GetChar(c);
             }
             if (!input.EndOfInput()) {
                 input.UngetChar(c);
             }
+            tmp.lexeme = scratch;       // the caller gives it storage
         }
+        tmp.id = -1;
         tmp.token_type = NUM;
         tmp.line_no = line_no;
         return tmp;
@@ -118,6 +392,7 @@ Token LexicalAnalyzer::ScanNumber()
         tmp.lexeme = "";
         tmp.token_type = ERROR;
         tmp.line_no = line_no;
+        tmp.id = -1;
         return tmp;
     }
 }
@@ -128,39 +403,150 @@ Token LexicalAnalyzer::ScanIdOrKeyword()
     char c;
     input.GetChar(c);
 
-    if (isalpha(c)) {
-        tmp.lexeme = "";
-        while (!input.EndOfInput() && isalnum(c)) {
-            tmp.lexeme += c;
+    if (IsAlphaChar(c)) {
+        scratch.clear();
+        while (!input.EndOfInput() && IsAlnumChar(c)) {
+            scratch += c;
             input.GetChar(c);
         }
         if (!input.EndOfInput()) {
             input.UngetChar(c);
         }
         tmp.line_no = line_no;
-        if (IsKeyword(tmp.lexeme))
-            tmp.token_type = FindKeywordIndex(tmp.lexeme);
-        else
-            tmp.token_type = ID;
+        SetIdOrKeyword(scratch);
     } else {
         if (!input.EndOfInput()) {
             input.UngetChar(c);
         }
         tmp.lexeme = "";
         tmp.token_type = ERROR;
+        tmp.id = -1;
     }
     return tmp;
 }
 
+// Classifies text as a keyword or an identifier and fills in tmp. Lexemes
+// that are not views into the span are given stable storage.
+void LexicalAnalyzer::SetIdOrKeyword(string_view text)
+{
+    tmp.token_type = FindKeywordIndex(text);
+    if (tmp.token_type != ERROR) {
+        tmp.lexeme = keyword[tmp.token_type - 1];
+        tmp.id = -1;
+    } else {
+        tmp.token_type = ID;
+        tmp.id = names.intern(text);
+        tmp.lexeme = input.HasSpan() ? text : names.name(tmp.id);
+    }
+}
+
+// The span engine: when the whole input is in memory, runs of whitespace,
+// digits and identifier characters are found by the selected RunScanner
+// and the lexeme is a view of the span. Produces the same tokens as the
+// character at a time path below.
+Token LexicalAnalyzer::GetTokenSpan()
+{
+    const char* base = input.Data();
+    const char* end = base + input.Size();
+    const char* p = scanner->skipSpace(base + input.Pos(), end, line_no);
+
+    tmp.lexeme = "";
+    tmp.line_no = line_no;
+    tmp.id = -1;
+    if (p == end) {
+        input.SetPos(p - base);
+        tmp.token_type = END_OF_FILE;
+        return tmp;
+    }
+
+    // InputBuffer::UngetChar() discards a byte equal to EOF, so the
+    // character path drops it where it would be pushed back: after
+    // SkipSpace, in which case the next character starts a token without
+    // skipping space, and after a number or identifier.
+    if (*p == EOF) {
+        if (++p == end) {
+            input.SetPos(p - base);
+            tmp.token_type = END_OF_FILE;
+            return tmp;
+        }
+    }
+
+    unsigned char c = *p;
+    const char* q = p + 1;
+    unsigned char cls = charClass.cls[c];
+    bool scannedRun = false;        // the character path read one past q
+    if (cls & CC_DIGIT) {
+        if (c != '0') {
+            q = scanner->digitEnd(q, end);
+            scannedRun = true;
+        }
+        tmp.token_type = NUM;
+        tmp.lexeme = string_view(p, q - p);
+    } else if (cls & CC_ALPHA) {
+        q = scanner->alnumEnd(q, end);
+        scannedRun = true;
+        SetIdOrKeyword(string_view(p, q - p));
+    } else {
+        tmp.token_type = charClass.punct[c];
+    }
+    if (scannedRun && q < end && *q == EOF)
+        q++;
+    input.SetPos(q - base);
+    return tmp;
+}
+
+Token LexicalAnalyzer::EndOfFileToken()
+{
+    Token token;
+    token.lexeme = "";
+    token.line_no = line_no;
+    token.token_type = END_OF_FILE;
+    token.id = -1;
+    return token;
+}
+
+// Streaming mode: lex until the ring holds howFar tokens or the input is
+// exhausted. Returns true if the ring holds at least howFar tokens. Number
+// lexemes read through cin are kept with their slot rather than interned,
+// so memory stays bounded however many distinct literals the input has.
+bool LexicalAnalyzer::FillRing(int howFar)
+{
+    while (ringCount < howFar && !inputDone) {
+        Token token = GetTokenMain();
+        if (token.token_type == END_OF_FILE) {
+            inputDone = true;
+            break;
+        }
+        int slot = (ringStart + ringCount) % LOOKAHEAD;
+        if (token.token_type == NUM && !input.HasSpan()) {
+            ringText[slot].assign(token.lexeme);
+            token.lexeme = ringText[slot];
+        }
+        ring[slot] = token;
+        ringCount++;
+    }
+    return ringCount >= howFar;
+}
+
 // GetToken() accesses tokens from the tokenList that is populated when a 
-// lexer object is instantiated
+// lexer object is instantiated, or from the lookahead ring in streaming mode
 Token LexicalAnalyzer::GetToken()
 {
     Token token;
-    if (index == tokenList.size()){       // return end of file if
-        token.lexeme = "";                // index is too large
-        token.line_no = line_no;
-        token.token_type = END_OF_FILE;
+    if (streaming) {
+        if (!FillRing(1))
+            return EndOfFileToken();
+        token = ring[ringStart];
+        if (token.token_type == NUM && !input.HasSpan()) {
+            lastText.swap(ringText[ringStart]);     // the slot may be refilled
+            token.lexeme = lastText;
+        }
+        ringStart = (ringStart + 1) % LOOKAHEAD;
+        ringCount--;
+        return token;
+    }
+    if (index == (int) tokenList.size()){ // return end of file if
+        token = EndOfFileToken();         // index is too large
     }
     else{
         token = tokenList[index];
@@ -175,17 +561,22 @@ Token LexicalAnalyzer::GetToken()
 Token LexicalAnalyzer::peek(int howFar)
 {
     if (howFar <= 0) {      // peeking backward or in place is not allowed
-        cout << "LexicalAnalyzer:peek:Error: non positive argument\n";
-        exit(-1);
+        throw invalid_argument("LexicalAnalyzer:peek:Error: non positive argument");
     } 
 
+    if (streaming) {
+        if (howFar > LOOKAHEAD) {
+            throw out_of_range("LexicalAnalyzer:peek:Error: lookahead exceeds " +
+                               to_string(LOOKAHEAD));
+        }
+        if (!FillRing(howFar))
+            return EndOfFileToken();
+        return ring[(ringStart + howFar - 1) % LOOKAHEAD];
+    }
+
     int peekIndex = index + howFar - 1;
-    if (peekIndex > (tokenList.size()-1)) { // if peeking too far
-        Token token;                        // return END_OF_FILE
-        token.lexeme = "";
-        token.line_no = line_no;
-        token.token_type = END_OF_FILE;
-        return token;
+    if (peekIndex >= (int) tokenList.size()) { // if peeking too far
+        return EndOfFileToken();               // return END_OF_FILE
     } else
         return tokenList[peekIndex];
 }
@@ -194,10 +585,14 @@ Token LexicalAnalyzer::GetTokenMain()
 {
     char c;
 
+    if (input.HasSpan())
+        return GetTokenSpan();
+
     SkipSpace();
     tmp.lexeme = "";
     tmp.line_no = line_no;
     tmp.token_type = END_OF_FILE;
+    tmp.id = -1;
     if (!input.EndOfInput())
         input.GetChar(c);
     else
@@ -213,10 +608,10 @@ Token LexicalAnalyzer::GetTokenMain()
         case ')': tmp.token_type = RPAREN;    return tmp;
         case ',': tmp.token_type = COMMA;     return tmp;
         default:
-            if (isdigit(c)) {
+            if (IsDigitChar(c)) {
                 input.UngetChar(c);
                 return ScanNumber();
-            } else if (isalpha(c)) {
+            } else if (IsAlphaChar(c)) {
                 input.UngetChar(c);
                 return ScanIdOrKeyword();
             } else if (input.EndOfInput())
@@ -8,8 +8,11 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
+#include <memory>
 
 #include "inputbuf.h"
+#include "intern.h"
 
 // ------- token types -------------------
 
@@ -20,32 +23,91 @@ typedef enum { END_OF_FILE = 0,
     PLUS, MINUS, SEMICOLON, ERROR,
     } TokenType;
 
+// Tokens are small values: the lexeme is a view into the input span (or,
+// when reading through cin, into storage owned by the lexer) and ID tokens
+// carry the interned id of their name. When streaming through cin, the
+// lexeme of a NUM token stays valid until the next GetToken().
 class Token {
   public:
     void Print();
 
-    std::string lexeme;
+    std::string_view lexeme;
     TokenType token_type;
     int line_no;
+    int id;             // interned name for ID tokens, -1 otherwise
 };
 
+// Value of a NUM lexeme, as atoi() gives it: digits beyond the range of
+// long saturate, and the result is narrowed to int. Used for task numbers
+// and exponents.
+int lexemeToInt(std::string_view s);
+
+// Value of a NUM lexeme used as a coefficient, an argument or an input:
+// digits beyond the range of __int128 saturate. The numeric domain decides
+// what the value means (see numdomain.h).
+__int128 lexemeToLiteral(std::string_view s);
+
+// Maximum lookahead supported by peek() in streaming mode
+#define LOOKAHEAD 4
+
+// Which run scanner the span engine uses; AUTO picks the widest vector
+// unit the CPU supports. All modes produce identical tokens.
+typedef enum { SCAN_AUTO, SCAN_SCALAR, SCAN_SSE2, SCAN_AVX2 } ScanMode;
+
+struct RunScanner;
+
 class LexicalAnalyzer {
   public:
     Token GetToken();
     Token peek(int);
     LexicalAnalyzer();
+    // With streaming set, tokens are produced on demand into a small ring
+    // instead of tokenizing the whole input up front; peek() is then
+    // limited to LOOKAHEAD tokens.
+    explicit LexicalAnalyzer(InputBuffer&, bool streaming = false,
+                             ScanMode scan = SCAN_AUTO);
+
+    // identifier ids handed out in Token::id
+    NameTable& Names() { return names; }
+
+    // Without streaming the whole input is tokenized up front; the parser
+    // may then read the tokens directly and move the position past them.
+    bool HasTokenList() const { return !streaming; }
+    const std::vector<Token>& Tokens() const { return tokenList; }
+    int Position() const { return index; }
+    void SetPosition(int pos) { index = pos; }
 
   private:
     std::vector<Token> tokenList;
+    bool streaming;
+    Token ring[LOOKAHEAD];
+    std::string ringText[LOOKAHEAD];    // number lexemes when there is no span
+    std::string lastText;               // and that of the token last returned
+    int ringStart;
+    int ringCount;
+    bool inputDone;
+    bool FillRing(int);
+    Token EndOfFileToken();
+    const RunScanner* scanner;
+
     Token GetTokenMain();
+    Token GetTokenSpan();
     int line_no;
     int index;
     Token tmp;
-    InputBuffer input;
+    std::unique_ptr<InputBuffer> ownedInput;
+    InputBuffer& input;
+
+    void Tokenize();
 
     bool SkipSpace();
-    bool IsKeyword(std::string);
-    TokenType FindKeywordIndex(std::string);
+    NameTable names;
+    NameTable literals;         // number lexemes of the token list when
+                                // there is no span
+    std::string scratch;
+
+    TokenType FindKeywordIndex(std::string_view);
+    void SetIdOrKeyword(std::string_view);
     Token ScanNumber();
     Token ScanIdOrKeyword();
 };
@@ -0,0 +1,542 @@
+#include "polyparser.h"
+#include "polysession.h"
+#include "inputbuf.h"
+#include "threadpool.h"
+#include "outsink.h"
+#include <iostream>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// Command line front end of the polyparser library: reads one program,
+// compiles it and prints what its TASKS ask for.
+
+//---------------------------------------
+// Reporting
+//---------------------------------------
+/// How OUTPUT values are written.
+struct OutputOptions {
+    bool binary = false;   // Little-endian integers of the domain's width instead of text
+    int bytes = 4;         // That width
+};
+
+// Width of a value of the domain in the binary format.
+static int domainBytes(NumDomain domain) {
+    switch (domain) {
+        case NumDomain::WRAP32: return 4;
+        case NumDomain::INT128: return 16;
+        default:                return 8;
+    }
+}
+
+static void printLines(OutputSink &out, string_view title, const vector<int> &lines) {
+    out.write(title);
+    out.put(':');
+    for (int ln : lines) {
+        out.put(' ');
+        out.writeInt(ln);
+    }
+    out.put('\n');
+}
+
+static void printStats(const PolyProgram &program, const ParserOptions &options,
+                       const MemoStats &memo) {
+    PlanStats st = program.planStats();
+    cerr << "cse: " << st.callSites << " calls, " << st.sharedCalls << " shared" << endl;
+    if (options.dce && options.domain != NumDomain::CHECKED)
+        cerr << "dce: " << st.deadStatements << " statements, " << st.deadCalls
+             << " calls eliminated" << endl;
+    if (options.fold)
+        cerr << "fold: " << st.foldedCalls << " folded, " << st.specializedCalls
+             << " specialized" << endl;
+    if (options.memoCapacity > 0)
+        cerr << "memo: " << memo.hits << " hits, " << memo.misses << " misses, "
+             << memo.evictions << " evictions" << endl;
+}
+
+// Prints the results of the tasks in task order; returns the exit status.
+// The errors, warnings and degrees come from analysis (the program itself
+// or an edit session); Task 2 runs program, which is null when there is
+// nothing to run. Everything but the statistics goes through out, which
+// is flushed before anything is written to cerr so that the two streams
+// keep their order.
+template <class Analysis>
+static int report(OutputSink &out, const Analysis &analysis, PolyProgram *program,
+                  const ParserOptions &options, const OutputOptions &format) {
+    if (options.stats && !options.cacheDir.empty() && program != nullptr)
+        cerr << "cache: " << (program->fromCache() ? "hit" : "miss") << endl;
+    if (analysis.status() == PolyStatus::SYNTAX_ERROR) {
+        out.write("SYNTAX ERROR !!!!!&%!!\n");
+        return 1;
+    }
+    if (analysis.status() == PolyStatus::SEMANTIC_ERROR) {
+        const SemanticError &err = analysis.semanticError();
+        printLines(out, "Semantic Error Code " + to_string(err.code), err.lines);
+        return 0;
+    }
+    if (analysis.hasTask(2) && program != nullptr) {
+        RunResult result = program->run();
+        for (__int128 v : result.outputs) {
+            if (format.binary) {
+                out.writeLE(v, format.bytes);
+            } else {
+                out.writeInt(v);
+                out.put('\n');
+            }
+        }
+        if (result.status == PolyStatus::OVERFLOW_ERROR) {
+            out.write("Overflow Error: ");
+            out.write(OverflowError().what());
+            out.put('\n');
+            return 1;
+        }
+        if (options.stats) {
+            out.flush();
+            printStats(*program, options, result.memo);
+        }
+    }
+    if (analysis.hasTask(3) && !analysis.uninitializedWarnings().empty())
+        printLines(out, "Warning Code 1", analysis.uninitializedWarnings());
+    if (analysis.hasTask(4) && !analysis.uselessWarnings().empty())
+        printLines(out, "Warning Code 2", analysis.uselessWarnings());
+    if (analysis.hasTask(5)) {
+        for (const PolyDegree &d : analysis.degrees()) {
+            out.write(d.name);
+            out.write(": ");
+            out.writeInt(d.degree);
+            out.put('\n');
+        }
+    }
+    if (options.batchVerify && program != nullptr) {
+        out.flush();
+        program->verifyBatch();
+    }
+    return 0;
+}
+
+//---------------------------------------
+// Run-many Mode (--inputs-file)
+//---------------------------------------
+static const size_t INPUTS_BLOCK = 1 << 22;   // Bytes of the inputs file read at a time
+static const size_t SHARD_LINES = 1024;       // Input lines per pool task
+
+// Record counts of the binary format that are not output counts.
+static const uint32_t RECORD_OVERFLOW = 0x80000000u;   // Or-ed into the count
+static const uint32_t RECORD_BAD_LINE = 0xffffffffu;
+
+/// Where the run-many mode reads input sets from and how it reports them.
+struct InputsFileOptions {
+    const char *path = nullptr;   // One input set per line; null when not in this mode
+    int threads = 0;              // Pool size, 0 for every hardware thread
+    bool tagged = false;          // Prefix results with their line and write shards as they end
+};
+
+// Reads the numbers of one line into values, split and converted as the
+// lexer does for an INPUTS section: "0" is a number by itself, any other
+// number is a run of digits, and values beyond the range of __int128
+// saturate (lexemeToLiteral). Returns false if the line holds anything
+// else, such as a sign.
+static bool parseInputsLine(const char *p, const char *end, vector<__int128> &values) {
+    values.clear();
+    for (;;) {
+        while (p < end && isspace((unsigned char)*p))
+            p++;
+        if (p == end)
+            return true;
+        if (!isdigit((unsigned char)*p))
+            return false;
+        const char *q = p + 1;
+        if (*p != '0') {
+            while (q < end && isdigit((unsigned char)*q))
+                q++;
+        }
+        values.push_back(lexemeToLiteral(string_view(p, q - p)));
+        p = q;
+    }
+}
+
+// Appends the results of one line. As text: the outputs separated by
+// spaces, then the overflow message if the run stopped on one. As binary:
+// a 4-byte count of outputs, with RECORD_OVERFLOW set if the run stopped
+// on one, then the outputs. Tagged lines start with their number, as
+// "N: " or as 8 bytes. A null result is a malformed line.
+static void formatResult(string &s, size_t line, const RunResult *r, bool tagged,
+                         const OutputOptions &format) {
+    if (format.binary) {
+        if (tagged)
+            appendLE(s, line, 8);
+        if (r == nullptr) {
+            appendLE(s, RECORD_BAD_LINE, 4);
+            return;
+        }
+        uint32_t count = (uint32_t)r->outputs.size();
+        if (r->status == PolyStatus::OVERFLOW_ERROR)
+            count |= RECORD_OVERFLOW;
+        appendLE(s, count, 4);
+        for (__int128 v : r->outputs)
+            appendLE(s, v, format.bytes);
+        return;
+    }
+    if (tagged) {
+        appendInt(s, line);
+        s += ": ";
+    }
+    if (r == nullptr) {
+        s += "INPUTS ERROR\n";
+        return;
+    }
+    for (size_t i = 0; i < r->outputs.size(); i++) {
+        if (i > 0)
+            s += ' ';
+        appendInt(s, r->outputs[i]);
+    }
+    if (r->status == PolyStatus::OVERFLOW_ERROR) {
+        if (!r->outputs.empty())
+            s += ' ';
+        s += "Overflow Error: ";
+        s += OverflowError().what();
+    }
+    s += '\n';
+}
+
+// Runs the program once per line of the inputs file. The file is read a
+// block of whole lines at a time; the lines of a block are cut into
+// shards that the pool parses, runs and formats independently, each
+// shard in its own execution contexts. Shards are written in file order,
+// or as soon as they end when tagged. A malformed line gives
+// "INPUTS ERROR" and makes the exit status 1.
+static int runInputsFile(OutputSink &out, const PolyProgram &program,
+                         const InputsFileOptions &opts, const OutputOptions &format) {
+    FILE *file = fopen(opts.path, "rb");
+    if (file == nullptr) {
+        out.write(string("InputBuffer: cannot open ") + opts.path + "\n");
+        return 255;
+    }
+    ThreadPool pool(opts.threads > 0 ? opts.threads : ThreadPool::hardwareThreads());
+    mutex outMutex;
+    bool anyBad = false;
+    size_t firstLine = 1;
+    string block;
+    vector<size_t> lineStart;
+    vector<string> shardText;                 // Reused from block to block
+    bool eof = false;
+    while (!eof) {
+        // Read until the block holds a line end or the file ends
+        size_t have;
+        do {
+            have = block.size();
+            block.resize(have + INPUTS_BLOCK);
+            size_t n = fread(&block[have], 1, INPUTS_BLOCK, file);
+            block.resize(have + n);
+            eof = n < INPUTS_BLOCK;
+        } while (!eof && block.find('\n', have) == string::npos);
+        size_t cut = eof ? block.size() : block.rfind('\n') + 1;
+        lineStart.clear();
+        for (size_t pos = 0; pos < cut; ) {
+            lineStart.push_back(pos);
+            const char *nl = (const char *)memchr(&block[pos], '\n', cut - pos);
+            pos = nl ? (size_t)(nl - block.data()) + 1 : cut;
+        }
+        lineStart.push_back(cut);
+        size_t lines = lineStart.size() - 1;
+        size_t shards = (lines + SHARD_LINES - 1) / SHARD_LINES;
+        if (shardText.size() < shards)
+            shardText.resize(shards);
+        vector<char> bad(shards, 0);
+        pool.run(shards, [&](size_t sh) {
+            size_t from = sh * SHARD_LINES, to = min(lines, from + SHARD_LINES);
+            vector<vector<__int128>> sets(to - from);
+            vector<char> valid(to - from);
+            for (size_t i = from; i < to; i++) {
+                const char *p = block.data() + lineStart[i];
+                const char *end = block.data() + lineStart[i + 1];
+                valid[i - from] = parseInputsLine(p, end, sets[i - from]);
+            }
+            vector<RunResult> results = program.runBatch(sets);
+            string &text = shardText[sh];
+            text.clear();
+            for (size_t i = from; i < to; i++) {
+                bool ok = valid[i - from];
+                formatResult(text, firstLine + i, ok ? &results[i - from] : nullptr,
+                             opts.tagged, format);
+                if (!ok)
+                    bad[sh] = 1;
+            }
+            if (opts.tagged) {
+                lock_guard<mutex> lock(outMutex);
+                out.write(text);
+            }
+        });
+        for (size_t sh = 0; sh < shards; sh++) {
+            if (!opts.tagged)
+                out.write(shardText[sh]);
+            anyBad = anyBad || bad[sh];
+        }
+        block.erase(0, cut);
+        firstLine += lines;
+    }
+    fclose(file);
+    return anyBad ? 1 : 0;
+}
+
+//---------------------------------------
+// Edit Mode (--edit-script)
+//---------------------------------------
+// Reads one edit: the byte offset, the number of bytes replaced and, after
+// a space, the replacement, in which \n, \t and \\ stand for a newline, a
+// tab and a backslash. Returns false if the line is malformed.
+static bool parseEditLine(const string &line, size_t &offset, size_t &length, string &text) {
+    const char *p = line.data(), *end = p + line.size();
+    from_chars_result r = from_chars(p, end, offset);
+    if (r.ec != errc() || r.ptr == end || *r.ptr != ' ')
+        return false;
+    r = from_chars(r.ptr + 1, end, length);
+    if (r.ec != errc() || (r.ptr < end && *r.ptr != ' '))
+        return false;
+    text.clear();
+    for (p = r.ptr < end ? r.ptr + 1 : end; p < end; p++) {
+        if (*p != '\\') {
+            text += *p;
+            continue;
+        }
+        if (++p == end)
+            return false;
+        switch (*p) {
+            case 'n': text += '\n'; break;
+            case 't': text += '\t'; break;
+            case '\\': text += '\\'; break;
+            default: return false;
+        }
+    }
+    return true;
+}
+
+// Loads the program into a PolySession, applies the edits of the script
+// in order and reports the edited program as if it had been read instead:
+// errors, warnings and degrees come from the session, and Task 2 compiles
+// the final text. A malformed edit, or one outside the text, gives
+// "EDIT ERROR: line N" and makes the exit status 1. --stats reports on
+// stderr how many units the edits parsed again.
+static int runEditScript(OutputSink &out, InputBuffer &input, const char *path,
+                         const ParserOptions &options, const OutputOptions &format) {
+    ifstream script(path, ios::binary);
+    if (!script) {
+        out.write(string("InputBuffer: cannot open ") + path + "\n");
+        return 255;
+    }
+    string source;
+    if (input.HasSpan())
+        source.assign(input.Data() + input.Pos(), input.Size() - input.Pos());
+    else
+        source.assign(istreambuf_iterator<char>(cin), istreambuf_iterator<char>());
+    PolySession session(source, options);
+    size_t edits = 0, reparsed = 0;
+    string line, text;
+    for (size_t n = 1; getline(script, line); n++) {
+        size_t offset, length;
+        if (!parseEditLine(line, offset, length, text) || offset > session.size() ||
+            length > session.size() - offset) {
+            out.write("EDIT ERROR: line ");
+            out.writeInt(n);
+            out.put('\n');
+            return 1;
+        }
+        session.edit(offset, length, text);
+        edits++;
+        reparsed += session.reparsedUnits();
+    }
+    if (options.stats)
+        cerr << "edits: " << edits << " applied, " << reparsed << " units parsed again, "
+             << session.units() << " units" << endl;
+    unique_ptr<PolyProgram> program;
+    if (session.status() == PolyStatus::OK && (session.hasTask(2) || options.batchVerify)) {
+        string edited = session.text();
+        program.reset(new PolyProgram(edited.data(), edited.size(), options));
+    }
+    return report(out, session, program.get(), options, format);
+}
+
+//---------------------------------------
+// Main (always included for autograder)
+//---------------------------------------
+static void usage() {
+    cout << "usage: poly_parser [--input-mode=auto|mmap|block|stream] [--stream-tokens]" << endl
+         << "                   [--scanner=auto|scalar|sse2|avx2]" << endl
+         << "                   [--no-horner] [--exact-degree] [--jit] [--jit-verify]" << endl
+         << "                   [--batch-verify]" << endl
+         << "                   [--domain=wrap32|int64|checked|int128|mod:M]" << endl
+         << "                   [--memo=N] [--stats] [--no-cse] [--no-fold]" << endl
+         << "                   [--no-dce] [--parallel-poly[=N]] [--parallel-exec[=N]]" << endl
+         << "                   [--lane-exec] [--inputs-file=PATH [--inputs-threads=N]" << endl
+         << "                   [--inputs-tagged]] [--output-format=text|binary]" << endl
+         << "                   [--cache-dir=DIR] [--edit-script=PATH]" << endl
+         << "                   [file]" << endl;
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    InputBuffer::Mode mode = InputBuffer::AUTO;
+    bool streamTokens = false;
+    ScanMode scan = SCAN_AUTO;
+    ParserOptions options;
+    const char *path = nullptr;
+    InputsFileOptions inputsFile;
+    bool binaryOutput = false;
+    const char *editScript = nullptr;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--input-mode=auto")
+            mode = InputBuffer::AUTO;
+        else if (arg == "--input-mode=mmap")
+            mode = InputBuffer::MAP;
+        else if (arg == "--input-mode=block")
+            mode = InputBuffer::BLOCK;
+        else if (arg == "--input-mode=stream")
+            mode = InputBuffer::STREAM;
+        else if (arg == "--stream-tokens")
+            streamTokens = true;
+        else if (arg == "--scanner=auto")
+            scan = SCAN_AUTO;
+        else if (arg == "--scanner=scalar")
+            scan = SCAN_SCALAR;
+        else if (arg == "--scanner=sse2")
+            scan = SCAN_SSE2;
+        else if (arg == "--scanner=avx2")
+            scan = SCAN_AVX2;
+        else if (arg == "--no-horner")
+            options.hornerEval = false;
+        else if (arg == "--exact-degree")
+            options.exactDegree = true;
+        else if (arg == "--jit")
+            options.jit = true;
+        else if (arg == "--jit-verify")
+            options.jit = options.jitVerify = true;
+        else if (arg == "--batch-verify")
+            options.batchVerify = true;
+        else if (arg.compare(0, 7, "--memo=") == 0) {
+            char *end;
+            options.memoCapacity = strtoull(arg.c_str() + 7, &end, 10);
+            if (*end != '\0' || arg.size() == 7)
+                usage();
+        }
+        else if (arg == "--stats")
+            options.stats = true;
+        else if (arg == "--no-cse")
+            options.cse = false;
+        else if (arg == "--no-fold")
+            options.fold = false;
+        else if (arg == "--no-dce")
+            options.dce = false;
+        else if (arg == "--parallel-exec")
+            options.execThreads = ThreadPool::hardwareThreads();
+        else if (arg.compare(0, 16, "--parallel-exec=") == 0) {
+            char *end;
+            long n = strtol(arg.c_str() + 16, &end, 10);
+            if (*end != '\0' || arg.size() == 16 || n < 1 || n > 1024)
+                usage();
+            options.execThreads = (int)n;
+        }
+        else if (arg.compare(0, 14, "--inputs-file=") == 0 && arg.size() > 14)
+            inputsFile.path = argv[i] + 14;
+        else if (arg.compare(0, 17, "--inputs-threads=") == 0) {
+            char *end;
+            long n = strtol(arg.c_str() + 17, &end, 10);
+            if (*end != '\0' || arg.size() == 17 || n < 1 || n > 1024)
+                usage();
+            inputsFile.threads = (int)n;
+        }
+        else if (arg == "--inputs-tagged")
+            inputsFile.tagged = true;
+        else if (arg == "--output-format=text")
+            binaryOutput = false;
+        else if (arg == "--output-format=binary")
+            binaryOutput = true;
+        else if (arg.compare(0, 12, "--cache-dir=") == 0 && arg.size() > 12)
+            options.cacheDir = arg.substr(12);
+        else if (arg.compare(0, 14, "--edit-script=") == 0 && arg.size() > 14)
+            editScript = argv[i] + 14;
+        else if (arg == "--lane-exec")
+            options.laneExec = true;
+        else if (arg == "--parallel-poly")
+            options.polyThreads = ThreadPool::hardwareThreads();
+        else if (arg.compare(0, 16, "--parallel-poly=") == 0) {
+            char *end;
+            long n = strtol(arg.c_str() + 16, &end, 10);
+            if (*end != '\0' || arg.size() == 16 || n < 1 || n > 1024)
+                usage();
+            options.polyThreads = (int)n;
+        }
+        else if (arg == "--domain=wrap32")
+            options.domain = NumDomain::WRAP32;
+        else if (arg == "--domain=int64")
+            options.domain = NumDomain::INT64;
+        else if (arg == "--domain=checked")
+            options.domain = NumDomain::CHECKED;
+        else if (arg == "--domain=int128")
+            options.domain = NumDomain::INT128;
+        else if (arg.compare(0, 13, "--domain=mod:") == 0) {
+            char *end;
+            options.domain = NumDomain::MOD;
+            options.modulus = strtoull(arg.c_str() + 13, &end, 10);
+            if (*end != '\0' || arg.size() == 13 || options.modulus < 2 ||
+                options.modulus >= (1ULL << 63))
+                usage();
+        }
+        else if (arg[0] != '-' && path == nullptr)
+            path = argv[i];
+        else
+            usage();
+    }
+    if (editScript != nullptr && inputsFile.path != nullptr)
+        usage();
+    if (path != nullptr && mode == InputBuffer::STREAM)
+        usage();
+    OutputSink out;
+    unique_ptr<InputBuffer> input;
+    try {
+        input.reset(path ? new InputBuffer(path, mode) : new InputBuffer(mode));
+    } catch (const runtime_error &e) {
+        out.write(e.what());
+        out.put('\n');
+        return 255;
+    }
+    OutputOptions format;
+    format.binary = binaryOutput;
+    format.bytes = domainBytes(options.domain);
+    int status;
+    try {
+        if (editScript != nullptr) {
+            status = runEditScript(out, *input, editScript, options, format);
+        } else {
+            PolyProgram program(move(input), streamTokens, scan, options);
+            if (inputsFile.path != nullptr && program.status() == PolyStatus::OK)
+                status = runInputsFile(out, program, inputsFile, format);
+            else
+                status = report(out, program, &program, options, format);
+        }
+    } catch (const VerifyError &e) {
+        out.flush();
+        cerr << e.what() << endl;
+        status = 2;
+    }
+    // A lost write (a full disk, a closed pipe) must not look like success
+    out.flush();
+    if (out.failed()) {
+        cerr << "OutputSink: cannot write: " << strerror(out.error()) << endl;
+        if (status == 0)
+            status = 255;
+    }
+    return status;
+}
@@ -0,0 +1,165 @@
+#ifndef MEMOCACHE_H
+#define MEMOCACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+///---------------------------------------------------------
+/// Memoization of Polynomial Evaluations (Task 2)
+///---------------------------------------------------------
+
+/// Hit and miss counters of a MemoCache.
+struct MemoStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+};
+
+/// Bounded cache from (polynomial index, argument tuple) to the value of
+/// the evaluation. Polynomials have no side effects, so a hit can stand in
+/// for the evaluation itself.
+///
+/// Entries live in an open-addressing table with linear probing, sized to
+/// a power of two at least twice the capacity. Argument tuples are stored
+/// inline in a key array with one fixed-width row per slot. When the cache
+/// is full, a CLOCK hand sweeps the slots: a slot referenced since the last
+/// sweep gets a second chance, the first one that was not is evicted, and
+/// the probe chain is repaired by shifting later entries back.
+template <class Value>
+class MemoCache {
+public:
+    /// capacity entries of at most maxArgs arguments each.
+    MemoCache(size_t capacity, int maxArgs)
+        : capacity(capacity), stride(maxArgs > 0 ? maxArgs : 1) {
+        size_t size = 16;
+        while (size < 2 * capacity)
+            size <<= 1;
+        mask = size - 1;
+        slots.resize(size);
+        keys.resize(size * stride);
+    }
+
+    /// Looks up poly(args); on a hit stores the value in out.
+    bool find(int poly, const Value *args, int numArgs, Value &out) {
+        uint64_t h = hashKey(poly, args, numArgs);
+        for (size_t i = h & mask; slots[i].used; i = (i + 1) & mask) {
+            if (matches(i, h, poly, args, numArgs)) {
+                slots[i].referenced = true;
+                out = slots[i].value;
+                stats.hits++;
+                return true;
+            }
+        }
+        stats.misses++;
+        return false;
+    }
+
+    /// Records poly(args) = value after a miss.
+    void insert(int poly, const Value *args, int numArgs, const Value &value) {
+        if (capacity == 0 || numArgs > stride)
+            return;
+        if (count >= capacity)
+            evict();
+        uint64_t h = hashKey(poly, args, numArgs);
+        size_t i = h & mask;
+        while (slots[i].used)
+            i = (i + 1) & mask;
+        Slot &s = slots[i];
+        s.used = true;
+        s.referenced = false;
+        s.hash = h;
+        s.poly = poly;
+        s.numArgs = numArgs;
+        s.value = value;
+        if (numArgs > 0)
+            memcpy(&keys[i * stride], args, numArgs * sizeof(Value));
+        count++;
+    }
+
+    const MemoStats &getStats() const { return stats; }
+
+private:
+    struct Slot {
+        uint64_t hash = 0;
+        int poly = 0;
+        int numArgs = 0;
+        bool used = false;
+        bool referenced = false;   // Hit since the clock hand last passed
+        Value value = Value();
+    };
+
+    size_t capacity;
+    int stride;                    // Key values per slot
+    size_t mask;
+    size_t count = 0;
+    size_t hand = 0;               // CLOCK position
+    std::vector<Slot> slots;
+    std::vector<Value> keys;
+    MemoStats stats;
+
+    static uint64_t mix(uint64_t h, uint64_t v) {
+        h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+        return h * 0xff51afd7ed558ccdULL;
+    }
+
+    static uint64_t hashKey(int poly, const Value *args, int numArgs) {
+        uint64_t h = mix(0, (uint64_t)poly);
+        for (int i = 0; i < numArgs; i++) {
+            uint64_t words[(sizeof(Value) + 7) / 8] = {};
+            memcpy(words, &args[i], sizeof(Value));
+            for (uint64_t w : words)
+                h = mix(h, w);
+        }
+        return h ^ (h >> 29);
+    }
+
+    bool matches(size_t i, uint64_t h, int poly, const Value *args, int numArgs) const {
+        const Slot &s = slots[i];
+        if (s.hash != h || s.poly != poly || s.numArgs != numArgs)
+            return false;
+        const Value *k = &keys[i * stride];
+        for (int a = 0; a < numArgs; a++) {
+            if (!(k[a] == args[a]))
+                return false;
+        }
+        return true;
+    }
+
+    void evict() {
+        for (;;) {
+            Slot &s = slots[hand];
+            if (s.used && !s.referenced) {
+                erase(hand);
+                stats.evictions++;
+                return;
+            }
+            s.referenced = false;
+            hand = (hand + 1) & mask;
+        }
+    }
+
+    // Backward-shift deletion: entries after the hole whose home slot does
+    // not lie strictly between the hole and themselves move into it.
+    void erase(size_t hole) {
+        size_t j = hole;
+        for (;;) {
+            j = (j + 1) & mask;
+            if (!slots[j].used)
+                break;
+            size_t home = slots[j].hash & mask;
+            bool between = hole <= j ? (hole < home && home <= j)
+                                     : (hole < home || home <= j);
+            if (between)
+                continue;
+            slots[hole] = slots[j];
+            memcpy(&keys[hole * stride], &keys[j * stride], stride * sizeof(Value));
+            hole = j;
+        }
+        slots[hole] = Slot();
+        count--;
+    }
+};
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef NUMDOMAIN_H
+#define NUMDOMAIN_H
+
+#include <climits>
+#include <cstdint>
+#include <stdexcept>
+
+///---------------------------------------------------------
+/// Numeric Domains for Evaluation (Task 2)
+///---------------------------------------------------------
+
+/// The arithmetic that EXECUTE statements are evaluated in, chosen on the
+/// command line. WRAP32 is the default and gives the usual int results.
+enum class NumDomain { WRAP32, INT64, CHECKED, INT128, MOD };
+
+/// Raised by the CHECKED domain when a result does not fit in 64 bits.
+class OverflowError : public std::overflow_error {
+public:
+    OverflowError() : std::overflow_error("value does not fit in 64 bits") {}
+};
+
+[[noreturn]] void checkedOverflow();
+
+/// Each domain is a small value type with the operations the evaluators
+/// are instantiated on: fromInt converts a literal or an input, given as
+/// the saturated __int128 of lexemeToLiteral, toInt gives back the int
+/// literal that fromInt maps to a value (if there is one), and add, sub
+/// and mul combine two values. fromInt((__int128)v) == v for every value,
+/// so any value can be written back as a literal. OUTPUT values are
+/// formatted by the caller (see OutputSink).
+
+/// 32-bit two's complement wrapping, done on unsigned values so that
+/// overflow is defined.
+struct Wrap32 {
+    typedef int Value;
+    Value fromInt(__int128 v) const { return (int)(uint32_t)v; }
+    bool toInt(Value v, int &out) const { out = v; return true; }
+    Value add(Value a, Value b) const { return (int)((uint32_t)a + (uint32_t)b); }
+    Value sub(Value a, Value b) const { return (int)((uint32_t)a - (uint32_t)b); }
+    Value mul(Value a, Value b) const { return (int)((uint32_t)a * (uint32_t)b); }
+};
+
+/// 64-bit two's complement wrapping.
+struct Int64 {
+    typedef long long Value;
+    Value fromInt(__int128 v) const { return (long long)(uint64_t)v; }
+    bool toInt(Value v, int &out) const { out = (int)v; return v >= INT_MIN && v <= INT_MAX; }
+    Value add(Value a, Value b) const { return (long long)((uint64_t)a + (uint64_t)b); }
+    Value sub(Value a, Value b) const { return (long long)((uint64_t)a - (uint64_t)b); }
+    Value mul(Value a, Value b) const { return (long long)((uint64_t)a * (uint64_t)b); }
+};
+
+/// 64-bit integers that raise OverflowError instead of overflowing,
+/// including on a literal or an input that does not fit.
+struct Checked64 {
+    typedef long long Value;
+    Value fromInt(__int128 v) const {
+        if (v < LLONG_MIN || v > LLONG_MAX)
+            checkedOverflow();
+        return (Value)v;
+    }
+    bool toInt(Value v, int &out) const { out = (int)v; return v >= INT_MIN && v <= INT_MAX; }
+    Value add(Value a, Value b) const {
+        Value r;
+        if (__builtin_add_overflow(a, b, &r))
+            checkedOverflow();
+        return r;
+    }
+    Value sub(Value a, Value b) const {
+        Value r;
+        if (__builtin_sub_overflow(a, b, &r))
+            checkedOverflow();
+        return r;
+    }
+    Value mul(Value a, Value b) const {
+        Value r;
+        if (__builtin_mul_overflow(a, b, &r))
+            checkedOverflow();
+        return r;
+    }
+};
+
+/// 128-bit two's complement wrapping.
+struct Int128 {
+    typedef __int128 Value;
+    typedef unsigned __int128 UValue;
+    Value fromInt(__int128 v) const { return v; }
+    bool toInt(Value v, int &out) const { out = (int)v; return v >= INT_MIN && v <= INT_MAX; }
+    Value add(Value a, Value b) const { return (Value)((UValue)a + (UValue)b); }
+    Value sub(Value a, Value b) const { return (Value)((UValue)a - (UValue)b); }
+    Value mul(Value a, Value b) const { return (Value)((UValue)a * (UValue)b); }
+};
+
+/// Residues modulo m, 2 <= m < 2^63, kept in [0, m).
+struct ModPrime {
+    typedef uint64_t Value;
+    uint64_t m;
+    explicit ModPrime(uint64_t modulus) : m(modulus) {}
+    Value fromInt(__int128 v) const {
+        __int128 r = v % (__int128)m;
+        return (Value)(r < 0 ? r + m : r);
+    }
+    bool toInt(Value v, int &out) const { out = (int)v; return v <= (Value)INT_MAX; }
+    Value add(Value a, Value b) const { Value r = a + b; return r >= m ? r - m : r; }
+    Value sub(Value a, Value b) const { return a >= b ? a - b : a + (m - b); }
+    Value mul(Value a, Value b) const {
+        return (Value)((unsigned __int128)a * b % m);
+    }
+};
+
+/// base^exp by repeated squaring. The base is not squared past the highest
+/// bit of exp, so a checked domain only overflows when the power does.
+template <class D>
+typename D::Value domainPow(const D &dom, typename D::Value base, int exp) {
+    typename D::Value res = dom.fromInt(1);
+    while (exp > 0) {
+        if (exp & 1)
+            res = dom.mul(res, base);
+        exp >>= 1;
+        if (exp > 0)
+            base = dom.mul(base, base);
+    }
+    return res;
+}
+
+#endif
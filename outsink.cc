@@ -0,0 +1,97 @@
+#include "outsink.h"
+
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <unistd.h>
+
+using namespace std;
+
+//---------------------------------------
+// Integer Formatting
+//---------------------------------------
+char *formatInt(char *buf, __int128 v) {
+    if (v >= INT64_MIN && v <= INT64_MAX)
+        return to_chars(buf, buf + INT_TEXT_MAX, (long long)v).ptr;
+    // Wider values: digits from the right into a scratch buffer
+    char tmp[INT_TEXT_MAX];
+    char *p = tmp + sizeof(tmp);
+    unsigned __int128 u = v < 0 ? -(unsigned __int128)v : (unsigned __int128)v;
+    do {
+        *--p = (char)('0' + (int)(u % 10));
+        u /= 10;
+    } while (u != 0);
+    if (v < 0)
+        *--p = '-';
+    size_t len = tmp + sizeof(tmp) - p;
+    memcpy(buf, p, len);
+    return buf + len;
+}
+
+void appendInt(string &s, __int128 v) {
+    char text[INT_TEXT_MAX];
+    s.append(text, formatInt(text, v));
+}
+
+void appendLE(string &s, __int128 v, int bytes) {
+    unsigned __int128 u = (unsigned __int128)v;
+    for (int i = 0; i < bytes; i++) {
+        s.push_back((char)(uint8_t)u);
+        u >>= 8;
+    }
+}
+
+//---------------------------------------
+// OutputSink
+//---------------------------------------
+OutputSink::OutputSink(int fd, size_t capacity) : fd(fd), buf(capacity > 64 ? capacity : 64) {}
+
+OutputSink::~OutputSink() {
+    flush();
+}
+
+void OutputSink::write(string_view s) {
+    if (s.size() > buf.size() - used) {
+        flush();
+        if (s.size() >= buf.size()) {
+            // Too big to buffer: hand it to the kernel as it is
+            writeAll(s.data(), s.size());
+            return;
+        }
+    }
+    memcpy(buf.data() + used, s.data(), s.size());
+    used += s.size();
+}
+
+void OutputSink::writeInt(__int128 v) {
+    if (buf.size() - used < INT_TEXT_MAX)
+        flush();
+    used = formatInt(buf.data() + used, v) - buf.data();
+}
+
+void OutputSink::writeLE(__int128 v, int bytes) {
+    unsigned __int128 u = (unsigned __int128)v;
+    for (int i = 0; i < bytes; i++) {
+        put((char)(uint8_t)u);
+        u >>= 8;
+    }
+}
+
+void OutputSink::flush() {
+    writeAll(buf.data(), used);
+    used = 0;
+}
+
+void OutputSink::writeAll(const char *data, size_t len) {
+    size_t done = 0;
+    while (done < len && err == 0) {
+        ssize_t n = ::write(fd, data + done, len - done);
+        if (n > 0)
+            done += n;
+        else if (n < 0 && errno != EINTR)
+            err = errno;
+        else if (n == 0)
+            err = EIO;
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef OUTSINK_H
+#define OUTSINK_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+///---------------------------------------------------------
+/// Output Sink
+///---------------------------------------------------------
+
+/// Longest decimal text formatInt writes: the sign and 39 digits.
+const size_t INT_TEXT_MAX = 40;
+
+/// Writes the decimal text of v to buf, which must hold INT_TEXT_MAX
+/// characters, and returns the end of the text. Values that fit in 64
+/// bits go through std::to_chars.
+char *formatInt(char *buf, __int128 v);
+
+/// Appends the decimal text of v to s.
+void appendInt(std::string &s, __int128 v);
+
+/// Appends the low bytes of v to s, least significant first.
+void appendLE(std::string &s, __int128 v, int bytes);
+
+/// Buffered writer to a file descriptor. Text and binary data are
+/// collected in one reusable buffer that is written out with a single
+/// write() when it fills up, on flush() and on destruction; nothing is
+/// locale-aware and nothing flushes per line. Interrupted writes are
+/// retried; after any other write error the sink drops further output and
+/// failed() reports it. Not thread-safe.
+class OutputSink {
+public:
+    explicit OutputSink(int fd = 1, size_t capacity = 1 << 16);
+    ~OutputSink();
+
+    OutputSink(const OutputSink &) = delete;
+    OutputSink &operator=(const OutputSink &) = delete;
+
+    void write(std::string_view s);
+    void put(char c) {
+        if (used == buf.size())
+            flush();
+        buf[used++] = c;
+    }
+    /// Decimal text of v.
+    void writeInt(__int128 v);
+    /// The low bytes of v, least significant first.
+    void writeLE(__int128 v, int bytes);
+
+    /// Writes out everything buffered so far.
+    void flush();
+
+    /// True once a write() has failed; error() is its errno.
+    bool failed() const { return err != 0; }
+    int error() const { return err; }
+
+private:
+    void writeAll(const char *data, size_t len);
+
+    int fd;
+    std::vector<char> buf;
+    size_t used = 0;
+    int err = 0;
+};
+
+#endif
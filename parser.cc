@@ -1,28 +1,60 @@
 #include "parser.h"
 #include "lexer.h"
+#include "threadpool.h"
+#include "progcache.h"
 #include <iostream>
 #include <cstdlib>
 #include <algorithm>
 #include <cassert>
+#include <climits>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <type_traits>
+#include <unordered_map>
 
 using namespace std;
 
 //---------------------------------------
 // Basic Helpers
 //---------------------------------------
-Parser::Parser(LexicalAnalyzer &lexer) : lexer(lexer) {}
+Parser::Parser(LexicalAnalyzer &lexer, const ParserOptions &options)
+    : lexer(lexer), options(options), names(lexer.Names()),
+      implicitParam(names.intern("x")) {}
+
+// Interning would race with the other workers, so a worker takes the
+// parent's id of "x"; it only reads the name table.
+Parser::Parser(const Parser &parent, const Token *tokens, size_t count)
+    : lexer(parent.lexer), options(parent.options), names(parent.names),
+      implicitParam(parent.implicitParam), chunkTokens(tokens), chunkEnd(count) {}
 
 void Parser::syntaxError() {
-    cout << "SYNTAX ERROR !!!!!&%!!" << endl;
-    exit(1);
+    throw SyntaxError();
 }
 
+// A worker sees END_OF_FILE past the end of its range.
 Token Parser::getNextToken() {
-    return lexer.GetToken();
+    if (chunkTokens == nullptr)
+        return lexer.GetToken();
+    if (chunkPos < chunkEnd)
+        return chunkTokens[chunkPos++];
+    Token t{};
+    t.token_type = END_OF_FILE;
+    t.id = -1;
+    return t;
 }
 
 Token Parser::peekToken(int k) {
-    return lexer.peek(k);
+    if (chunkTokens == nullptr)
+        return lexer.peek(k);
+    if (chunkPos + k - 1 < chunkEnd)
+        return chunkTokens[chunkPos + k - 1];
+    Token t{};
+    t.token_type = END_OF_FILE;
+    t.id = -1;
+    return t;
 }
 
 void Parser::expect(TokenType expected) {
@@ -32,9 +64,9 @@ void Parser::expect(TokenType expected) {
 }
 
 //---------------------------------------
-// Main parseProgram (Tasks 1-5)
+// Compilation (Tasks 1-5)
 //---------------------------------------
-void Parser::parseProgram() {
+void Parser::compile() {
     parseTasksSection();
     parsePolySection();
     parseExecuteSection();
@@ -42,8 +74,89 @@ void Parser::parseProgram() {
     Token t = getNextToken();
     if (t.token_type != END_OF_FILE)
         syntaxError();
-    checkSemanticErrors();
-    doOtherTasks();
+    if (!checkSemanticErrors())
+        return;
+    if (doTask2) {
+        partialEvaluate();
+        if (options.jit && options.domain == NumDomain::WRAP32)
+            jitReady = jit.compile(polyCode);
+    }
+    if (doTask5 && options.exactDegree)
+        expandPolynomials();
+    sort(uninitWarnLines.begin(), uninitWarnLines.end());
+    if (doTask4) {
+        detectUselessAssignments();
+        sort(uselessWarnLines.begin(), uselessWarnLines.end());
+    }
+}
+
+// A unit is parsed alone, so every evaluation in it is of an undeclared
+// polynomial and every variable is uninitialized; the summary is read from
+// what the productions record anyway.
+void Parser::parseUnit(UnitSection section, ParsedUnit &unit) {
+    if (section == UnitSection::START) {
+        parseTasksSection();
+        expect(POLY);
+        parsePolyDecl();
+    } else if (section == UnitSection::POLY && peekToken().token_type != EXECUTE) {
+        parsePolyDecl();
+    } else if (section == UnitSection::EXEC && peekToken().token_type == INPUTS) {
+        parseInputsSection();
+    } else {
+        if (section == UnitSection::POLY)
+            expect(EXECUTE);
+        statements.push_back(parseStatement());
+    }
+    expect(END_OF_FILE);
+
+    unit = ParsedUnit();
+    if (section == UnitSection::START) {
+        for (int n = 1; n <= 5; n++) {
+            if (hasTask(n))
+                unit.tasks.push_back(n);
+        }
+    } else {
+        unit.inputs = inputValues;
+    }
+    if (!polyTable.empty()) {
+        const PolyHeader &ph = polyTable[0];
+        if (options.exactDegree)
+            expandPolynomials();
+        unit.isDecl = true;
+        unit.decl = UnitName{ph.name, ph.line};
+        unit.numParams = (int)ph.params.size();
+        unit.degree = ph.exactDegree >= 0 ? ph.exactDegree : ph.degree;
+        unit.badNameLines = semErr2Lines;
+    }
+    if (!statements.empty()) {
+        vector<int> slotName(numSlots);
+        for (int name = 0; name < (int)nameSlot.size(); name++) {
+            if (nameSlot[name] >= 0)
+                slotName[nameSlot[name]] = name;
+        }
+        const Statement &st = statements[0];
+        unit.isStmt = true;
+        unit.stmtType = st.type;
+        unit.var = UnitName{slotName[st.type == StmtType::ASSIGN_STMT ? st.lhsSlot : st.slot],
+                            st.line};
+        for (const PolyEvalExec &pe : evals)
+            unit.calls.push_back(UnitName{pe.name, pe.line, pe.numArgs});
+        for (const PolyEvalArg &a : evalArgs) {
+            if (a.kind == ArgKind::VAR)
+                unit.reads.push_back(UnitName{slotName[a.slot], a.line});
+        }
+    }
+}
+
+bool Parser::hasTask(int n) const {
+    switch (n) {
+        case 1: return doTask1;
+        case 2: return doTask2;
+        case 3: return doTask3;
+        case 4: return doTask4;
+        case 5: return doTask5;
+        default: return false;
+    }
 }
 
 //---------------------------------------
@@ -62,14 +175,24 @@ void Parser::parseTasksSection() {
     }
 }
 
+// The list productions below are written as loops rather than one call
+// per element, so sections of any length parse in constant stack.
 void Parser::parseNumList(vector<int>& numList) {
-    Token t = getNextToken();
-    if (t.token_type != NUM)
-        syntaxError();
-    numList.push_back(atoi(t.lexeme.c_str()));
-    Token nxt = peekToken();
-    if (nxt.token_type == NUM)
-        parseNumList(numList);
+    do {
+        Token t = getNextToken();
+        if (t.token_type != NUM)
+            syntaxError();
+        numList.push_back(lexemeToInt(t.lexeme));
+    } while (peekToken().token_type == NUM);
+}
+
+void Parser::parseNumList(vector<__int128>& numList) {
+    do {
+        Token t = getNextToken();
+        if (t.token_type != NUM)
+            syntaxError();
+        numList.push_back(lexemeToLiteral(t.lexeme));
+    } while (peekToken().token_type == NUM);
 }
 
 //---------------------------------------
@@ -77,80 +200,180 @@ void Parser::parseNumList(vector<int>& numList) {
 //---------------------------------------
 void Parser::parsePolySection() {
     expect(POLY);
-    parsePolyDeclList();
+    if (options.polyThreads > 0 && lexer.HasTokenList())
+        parsePolyDeclListParallel();
+    else
+        parsePolyDeclList();
 }
 
 void Parser::parsePolyDeclList() {
     Token t = peekToken();
-    if (t.token_type == ID) {
+    if (t.token_type != ID)
+        syntaxError();
+    while (t.token_type == ID) {
         parsePolyDecl();
         t = peekToken();
-        if (t.token_type == ID)
-            parsePolyDeclList();
-        else if (t.token_type == EXECUTE)
-            return;
-        else
-            syntaxError();
-    } else {
+    }
+    if (t.token_type != EXECUTE)
         syntaxError();
+}
+
+// Declarations hold no semicolon but the one that ends them, so cutting the
+// section after semicolons gives runs of whole declarations. The runs are
+// parsed on a thread pool and declared here in order; the arenas are
+// appended in the same order, so every node index, error line and degree
+// is what the serial parse gives. A section that does not end with a
+// semicolon right before EXECUTE is left to the serial parser, which
+// reports it.
+void Parser::parsePolyDeclListParallel() {
+    const vector<Token> &tokens = lexer.Tokens();
+    size_t begin = lexer.Position(), end = begin;
+    vector<size_t> declEnds;              // One past each semicolon
+    while (end < tokens.size() && tokens[end].token_type != EXECUTE) {
+        if (tokens[end].token_type == SEMICOLON)
+            declEnds.push_back(end + 1);
+        end++;
+    }
+    if (end == tokens.size() || declEnds.empty() || declEnds.back() != end) {
+        parsePolyDeclList();
+        return;
+    }
+
+    int threads = options.polyThreads;
+    size_t target = (end - begin) / min(declEnds.size(), (size_t)threads * 8);
+    vector<size_t> bounds{begin};         // Chunk k is tokens [bounds[k], bounds[k+1])
+    for (size_t e : declEnds) {
+        if (e - bounds.back() >= target || e == end)
+            bounds.push_back(e);
+    }
+    size_t numChunks = bounds.size() - 1;
+    vector<unique_ptr<Parser>> parts(numChunks);
+    vector<char> failed(numChunks, 0);
+    ThreadPool pool(threads);
+    pool.run(numChunks, [&](size_t k) {
+        parts[k].reset(new Parser(*this, &tokens[bounds[k]], bounds[k + 1] - bounds[k]));
+        try {
+            while (parts[k]->chunkPos < parts[k]->chunkEnd)
+                parts[k]->parsePolyDecl();
+        } catch (const SyntaxError &) {
+            failed[k] = 1;
+        }
+    });
+    for (char f : failed) {
+        if (f)
+            syntaxError();
+    }
+
+    // Every chunk's place in the arena follows from the sizes of the ones
+    // before it, so the chunks are copied in parallel too.
+    vector<int> nodeBase(numChunks + 1), childBase(numChunks + 1);
+    nodeBase[0] = (int)ast.nodes.size();
+    childBase[0] = (int)ast.children.size();
+    for (size_t k = 0; k < numChunks; k++) {
+        nodeBase[k + 1] = nodeBase[k] + (int)parts[k]->ast.nodes.size();
+        childBase[k + 1] = childBase[k] + (int)parts[k]->ast.children.size();
+    }
+    ast.nodes.resize(nodeBase[numChunks]);
+    ast.children.resize(childBase[numChunks]);
+    pool.run(numChunks, [&](size_t k) {
+        ast.place(parts[k]->ast, nodeBase[k], childBase[k]);
+        parts[k]->ast = ASTArena();
+    });
+
+    lexer.SetPosition((int)end);
+    for (size_t k = 0; k < numChunks; k++) {
+        for (ParsedDecl &d : parts[k]->parsedDecls)
+            declarePoly(std::move(d.header), d.root + nodeBase[k], d.degree);
+        semErr2Lines.insert(semErr2Lines.end(), parts[k]->semErr2Lines.begin(),
+                            parts[k]->semErr2Lines.end());
+        parts[k].reset();
     }
 }
 
 void Parser::parsePolyDecl() {
-    parsePolyHeader();
+    PolyHeader ph = parsePolyHeader();
+    setCurrentParams(ph.params);
     expect(EQUAL);
     int deg = 0;
-    ASTNode* root = parseTermListNode(deg);
+    int root = parseTermListNode(deg);
+    expect(SEMICOLON);
+    if (chunkTokens != nullptr)
+        parsedDecls.push_back(ParsedDecl{std::move(ph), root, deg});
+    else
+        declarePoly(std::move(ph), root, deg);
+}
+
+// Records a parsed declaration. A duplicate name only adds its line to
+// Semantic Error 1; its body is kept so that polyASTs stays in source order.
+void Parser::declarePoly(PolyHeader &&ph, int root, int degree) {
+    if (findPoly(ph.name) >= 0) {
+        semErr1Lines.push_back(ph.line);
+    } else {
+        if (ph.name >= (int)namePoly.size())
+            namePoly.resize(names.size(), -1);
+        namePoly[ph.name] = (int)polyTable.size();
+        polyTable.push_back(std::move(ph));
+    }
     polyASTs.push_back(root);
     if (!polyTable.empty())
-        polyTable.back().degree = deg;
-    expect(SEMICOLON);
+        polyTable.back().degree = degree;
 }
 
-void Parser::parsePolyHeader() {
+PolyHeader Parser::parsePolyHeader() {
     Token polyTok = getNextToken();
     if (polyTok.token_type != ID)
         syntaxError();
-    string polyName = polyTok.lexeme;
+    int polyName = polyTok.id;
     int polyLine = polyTok.line_no;
-    vector<string> params;
+    vector<int> params;
     Token t = peekToken();
     if (t.token_type == LPAREN) {
         expect(LPAREN);
         parseIdList(params);
         expect(RPAREN);
     } else {
-        params.push_back("x");
-    }
-    bool duplicate = false;
-    for (auto &ph : polyTable) {
-        if (ph.name == polyName) {
-            duplicate = true;
-            break;
-        }
-    }
-    if (duplicate)
-        semErr1Lines.push_back(polyLine);
-    else {
-        PolyHeader ph;
-        ph.name = polyName;
-        ph.params = params;
-        ph.line = polyLine;
-        ph.degree = 0;
-        polyTable.push_back(ph);
+        params.push_back(implicitParam);
     }
+    PolyHeader ph;
+    ph.name = polyName;
+    ph.params = std::move(params);
+    ph.line = polyLine;
+    ph.degree = 0;
+    return ph;
+}
+
+int Parser::findPoly(int name) const {
+    return name < (int)namePoly.size() ? namePoly[name] : -1;
+}
+
+int Parser::findParam(int name) const {
+    return name < (int)nameParam.size() ? nameParam[name] : -1;
+}
+
+// Makes params the names a body may use. Only the previous declaration's
+// entries are cleared, so each header costs time in its own length; a
+// repeated parameter name resolves to its first position.
+void Parser::setCurrentParams(const vector<int> &params) {
+    for (int name : currentPolyParams)
+        nameParam[name] = -1;
     currentPolyParams = params;
+    for (int i = 0; i < (int)params.size(); i++) {
+        if (params[i] >= (int)nameParam.size())
+            nameParam.resize(names.size(), -1);
+        if (nameParam[params[i]] < 0)
+            nameParam[params[i]] = i;
+    }
 }
 
-void Parser::parseIdList(vector<string>& params) {
-    Token t = getNextToken();
-    if (t.token_type != ID)
-        syntaxError();
-    params.push_back(t.lexeme);
-    Token nxt = peekToken();
-    if (nxt.token_type == COMMA) {
+void Parser::parseIdList(vector<int>& params) {
+    for (;;) {
+        Token t = getNextToken();
+        if (t.token_type != ID)
+            syntaxError();
+        params.push_back(t.id);
+        if (peekToken().token_type != COMMA)
+            break;
         expect(COMMA);
-        parseIdList(params);
     }
 }
 
@@ -162,142 +385,148 @@ void Parser::parsePolyBody() {
 //---------------------------------------
 // AST Building for Polynomial Body (Task 5)
 //---------------------------------------
-ASTNode* Parser::parseTermListNode(int &outDegree) {
-    int dTerm = 0;
-    ASTNode* firstTerm = parseTermNode(dTerm);
-    ASTNode* termList = new ASTNode();
-    termList->kind = NodeKind::TERM_LIST;
-    termList->children.push_back(firstTerm);
-    outDegree = dTerm;
-    Token t = peekToken();
-    while (t.token_type == PLUS || t.token_type == MINUS) {
-        Token opTok = getNextToken(); // consume operator
-        int sign = (opTok.token_type == PLUS) ? +1 : -1;
-        int d2 = 0;
-        ASTNode* nextTerm = parseTermNode(d2);
-        nextTerm->add_op = sign;
-        termList->children.push_back(nextTerm);
-        if (d2 > outDegree)
-            outDegree = d2;
-        t = peekToken();
-    }
-    return termList;
-}
 
-ASTNode* Parser::parseTermNode(int &outDegree) {
-    Token t = peekToken();
-    if (t.token_type == NUM) {
-        Token coeffTok = getNextToken();
-        int coeff = atoi(coeffTok.lexeme.c_str());
-        Token nxt = peekToken();
-        if (nxt.token_type == ID || nxt.token_type == LPAREN) {
-            int dMono = 0;
-            ASTNode* monoList = parseMonomialListNode(dMono);
-            outDegree = dMono;
-            ASTNode* termNode = new ASTNode();
-            termNode->kind = NodeKind::TERM;
-            termNode->value = coeff;
-            termNode->children.push_back(monoList);
-            return termNode;
-        } else {
-            outDegree = 0;
-            ASTNode* termNode = new ASTNode();
-            termNode->kind = NodeKind::TERM;
-            termNode->value = coeff;
-            return termNode;
-        }
-    } else if (t.token_type == ID || t.token_type == LPAREN) {
-        int dMono = 0;
-        ASTNode* monoList = parseMonomialListNode(dMono);
-        outDegree = dMono;
-        ASTNode* termNode = new ASTNode();
-        termNode->kind = NodeKind::TERM;
-        termNode->value = 1;
-        termNode->children.push_back(monoList);
-        return termNode;
-    } else {
-        syntaxError();
-        return nullptr;
-    }
+// Children are pushed on childStack while a node is being built and copied
+// into the arena as one range once the node is complete.
+void Parser::setChildren(int node, size_t stackBase) {
+    ASTNode &n = ast.nodes[node];
+    n.firstChild = (int)ast.children.size();
+    n.numChildren = (int)(childStack.size() - stackBase);
+    ast.children.insert(ast.children.end(), childStack.begin() + stackBase, childStack.end());
+    childStack.resize(stackBase);
 }
 
-ASTNode* Parser::parseMonomialListNode(int &outDegree) {
-    int dMono = 0;
-    ASTNode* firstMono = parseMonomialNode(dMono);
-    ASTNode* ml = new ASTNode();
-    ml->kind = NodeKind::MONO_LIST;
-    ml->children.push_back(firstMono);
-    outDegree = dMono;
-    Token t = peekToken();
-    while (t.token_type == ID || t.token_type == LPAREN) {
-        int d2 = 0;
-        ASTNode* nxt = parseMonomialNode(d2);
-        ml->children.push_back(nxt);
-        outDegree += d2; // sum degrees of monomials in product
-        t = peekToken();
-    }
-    return ml;
+void Parser::setChild(int node, int child) {
+    ast.nodes[node].firstChild = (int)ast.children.size();
+    ast.nodes[node].numChildren = 1;
+    ast.children.push_back(child);
 }
 
-ASTNode* Parser::parseMonomialNode(int &outDegree) {
-    int dPrim = 0;
-    ASTNode* prim = parsePrimaryNode(dPrim);
-    int exponent = 1;
-    Token t = peekToken();
-    if (t.token_type == POWER) {
-        exponent = parseExponent();
-    }
-    outDegree = dPrim * exponent;
-    ASTNode* mono = new ASTNode();
-    mono->kind = NodeKind::MONO;
-    mono->value = exponent;
-    mono->children.push_back(prim);
-    return mono;
-}
+// A term list that is still open: the outermost one is the body, every
+// other one is inside a parenthesized primary.
+struct TermListFrame {
+    size_t termBase;          // childStack position of the list's first term
+    int degree = 0;           // Largest term degree so far
+    int sign = 0;             // add_op of the term being parsed, 0 for the first
+    __int128 coeff = 1;       // Coefficient of the term being parsed
+    size_t monoBase = 0;      // childStack position of that term's first monomial
+    int monoDegree = 0;       // Sum of that term's monomial degrees so far
+};
 
-ASTNode* Parser::parsePrimaryNode(int &outDegree) {
-    Token t = peekToken();
-    if (t.token_type == ID) {
-        Token idTok = getNextToken();
-        bool found = false;
-        int idx = -1;
-        for (int i = 0; i < (int)currentPolyParams.size(); i++) {
-            if (idTok.lexeme == currentPolyParams[i]) {
-                found = true;
-                idx = i;
+// Bodies only nest through parenthesized primaries, so instead of
+// recursing term list -> term -> monomial -> primary -> term list, one
+// frame per open parenthesis is kept on an explicit stack. Nodes are
+// still created children first, exactly as the recursive descent did.
+int Parser::parseTermListNode(int &outDegree) {
+    enum { TERM, PRIMARY, MONOMIAL, TERM_END } state = TERM;
+    vector<TermListFrame> open;
+    open.push_back(TermListFrame{childStack.size()});
+    int node = -1, degree = 0;    // Node just completed and its degree
+    for (;;) {
+        TermListFrame &f = open.back();
+        switch (state) {
+            case TERM: {
+                Token t = peekToken();
+                f.coeff = 1;
+                if (t.token_type == NUM) {
+                    f.coeff = lexemeToLiteral(getNextToken().lexeme);
+                    t = peekToken();
+                    if (t.token_type != ID && t.token_type != LPAREN) {
+                        node = ast.newNode(NodeKind::TERM);
+                        ast.nodes[node].value = f.coeff;
+                        degree = 0;
+                        state = TERM_END;
+                        break;
+                    }
+                } else if (t.token_type != ID && t.token_type != LPAREN) {
+                    syntaxError();
+                }
+                f.monoBase = childStack.size();
+                f.monoDegree = 0;
+                state = PRIMARY;
+                break;
+            }
+            case PRIMARY:
+                if (peekToken().token_type == LPAREN) {
+                    expect(LPAREN);
+                    open.push_back(TermListFrame{childStack.size()});
+                    state = TERM;
+                } else {
+                    node = parsePrimaryId();
+                    degree = 1;
+                    state = MONOMIAL;
+                }
+                break;
+            case MONOMIAL: {
+                int exponent = 1;
+                if (peekToken().token_type == POWER)
+                    exponent = parseExponent();
+                int mono = ast.newNode(NodeKind::MONO);
+                ast.nodes[mono].value = exponent;
+                setChild(mono, node);
+                childStack.push_back(mono);
+                f.monoDegree += degree * exponent; // sum degrees of monomials in product
+                Token t = peekToken();
+                if (t.token_type == ID || t.token_type == LPAREN) {
+                    state = PRIMARY;
+                    break;
+                }
+                int ml = ast.newNode(NodeKind::MONO_LIST);
+                setChildren(ml, f.monoBase);
+                node = ast.newNode(NodeKind::TERM);
+                ast.nodes[node].value = f.coeff;
+                setChild(node, ml);
+                degree = f.monoDegree;
+                state = TERM_END;
+                break;
+            }
+            case TERM_END: {
+                if (f.sign != 0)
+                    ast.nodes[node].add_op = f.sign;
+                if (childStack.size() == f.termBase || degree > f.degree)
+                    f.degree = degree;
+                childStack.push_back(node);
+                Token t = peekToken();
+                if (t.token_type == PLUS || t.token_type == MINUS) {
+                    f.sign = getNextToken().token_type == PLUS ? +1 : -1;
+                    state = TERM;
+                    break;
+                }
+                int termList = ast.newNode(NodeKind::TERM_LIST);
+                setChildren(termList, f.termBase);
+                degree = f.degree;
+                open.pop_back();
+                if (open.empty()) {
+                    outDegree = degree;
+                    return termList;
+                }
+                expect(RPAREN);
+                node = ast.newNode(NodeKind::PRIMARY);
+                ast.nodes[node].paramIndex = -1;
+                setChild(node, termList);
+                state = MONOMIAL;
                 break;
             }
         }
-        if (!found)
-            semErr2Lines.push_back(idTok.line_no);
-        outDegree = 1;
-        ASTNode* node = new ASTNode();
-        node->kind = NodeKind::PRIMARY;
-        node->paramIndex = (found ? idx : -1);
-        return node;
-    } else if (t.token_type == LPAREN) {
-        expect(LPAREN);
-        int dTL = 0;
-        ASTNode* sub = parseTermListNode(dTL);
-        outDegree = dTL;
-        expect(RPAREN);
-        ASTNode* node = new ASTNode();
-        node->kind = NodeKind::PRIMARY;
-        node->paramIndex = -1;
-        node->children.push_back(sub);
-        return node;
-    } else {
-        syntaxError();
-        return nullptr;
     }
 }
 
+int Parser::parsePrimaryId() {
+    Token idTok = getNextToken();
+    int idx = findParam(idTok.id);
+    if (idx < 0)
+        semErr2Lines.push_back(idTok.line_no);
+    int node = ast.newNode(NodeKind::PRIMARY);
+    ast.nodes[node].paramIndex = idx;
+    return node;
+}
+
 int Parser::parseExponent() {
     expect(POWER);
     Token t = getNextToken();
     if (t.token_type != NUM)
         syntaxError();
-    return atoi(t.lexeme.c_str());
+    return lexemeToInt(t.lexeme);
 }
 
 //---------------------------------------
@@ -310,15 +539,12 @@ void Parser::parseExecuteSection() {
 
 void Parser::parseStatementList() {
     Token t = peekToken();
-    if (t.token_type == INPUT || t.token_type == OUTPUT || t.token_type == ID) {
-        Statement st = parseStatement();
-        statements.push_back(st);
-        t = peekToken();
-        if (t.token_type == INPUT || t.token_type == OUTPUT || t.token_type == ID)
-            parseStatementList();
-    } else {
+    if (t.token_type != INPUT && t.token_type != OUTPUT && t.token_type != ID)
         syntaxError();
-    }
+    do {
+        statements.push_back(parseStatement());
+        t = peekToken();
+    } while (t.token_type == INPUT || t.token_type == OUTPUT || t.token_type == ID);
 }
 
 Statement Parser::parseStatement() {
@@ -343,9 +569,8 @@ Statement Parser::parseInputStatement() {
     Token varTok = getNextToken();
     if (varTok.token_type != ID)
         syntaxError();
-    st.varName = varTok.lexeme;
-    getLocation(st.varName);
-    initializedVars[st.varName] = true;
+    st.slot = slotOf(varTok.id);
+    initializedSlots[st.slot] = true;
     expect(SEMICOLON);
     st.line = varTok.line_no;
     return st;
@@ -358,9 +583,8 @@ Statement Parser::parseOutputStatement() {
     Token varTok = getNextToken();
     if (varTok.token_type != ID)
         syntaxError();
-    st.varName = varTok.lexeme;
-    getLocation(st.varName);
-    if (!initializedVars[st.varName])
+    st.slot = slotOf(varTok.id);
+    if (!initializedSlots[st.slot])
         uninitWarnLines.push_back(varTok.line_no);
     expect(SEMICOLON);
     st.line = varTok.line_no;
@@ -373,84 +597,101 @@ Statement Parser::parseAssignStatement() {
     Token varTok = getNextToken(); // LHS variable
     if (varTok.token_type != ID)
         syntaxError();
-    st.lhsVar = varTok.lexeme;
-    getLocation(st.lhsVar);
+    st.lhsSlot = slotOf(varTok.id);
     expect(EQUAL);
+    st.firstEval = (int)evals.size();
     st.rhsEval = parsePolyEvaluationExec();
     expect(SEMICOLON);
     st.line = varTok.line_no;
-    initializedVars[st.lhsVar] = true;
+    initializedSlots[st.lhsSlot] = true;
     return st;
 }
 
-PolyEvalExec Parser::parsePolyEvaluationExec() {
-    PolyEvalExec pe;
-    Token polyTok = getNextToken();
-    if (polyTok.token_type != ID)
-        syntaxError();
-    int foundIndex = -1;
-    for (int i = 0; i < (int)polyTable.size(); i++) {
-        if (polyTable[i].name == polyTok.lexeme) {
-            foundIndex = i;
-            break;
+// Parses an evaluation and everything nested in its arguments; returns its
+// index in evals. Calls that are still open wait on an explicit stack, and
+// the arguments parsed so far on argStack, so nesting depth costs no native
+// stack.
+int Parser::parsePolyEvaluationExec() {
+    struct OpenCall {
+        int polyIndex;
+        int name;
+        int line;
+        size_t argBase;       // argStack position of its first argument
+    };
+    vector<OpenCall> open;
+    for (;;) {
+        Token polyTok = getNextToken();
+        if (polyTok.token_type != ID)
+            syntaxError();
+        int foundIndex = findPoly(polyTok.id);
+        if (foundIndex < 0)
+            semErr3Lines.push_back(polyTok.line_no);
+        expect(LPAREN);
+        open.push_back(OpenCall{foundIndex, polyTok.id, polyTok.line_no, argStack.size()});
+        // Arguments of the innermost open call, until one of them is a
+        // nested call; each call that closes becomes an argument of the
+        // one around it.
+        while (parseArgumentExec()) {
+            while (peekToken().token_type != COMMA) {
+                expect(RPAREN);
+                OpenCall c = open.back();
+                open.pop_back();
+                int index = closePolyEvaluationExec(c.polyIndex, c.name, c.line, c.argBase);
+                if (open.empty())
+                    return index;
+                PolyEvalArg a;
+                a.kind = ArgKind::POLY_EVAL;
+                a.eval = index;
+                argStack.push_back(a);
+            }
+            expect(COMMA);
         }
     }
-    if (foundIndex < 0)
-        semErr3Lines.push_back(polyTok.line_no);
-    pe.polyIndex = foundIndex;
-    expect(LPAREN);
-    vector<PolyEvalArg> args;
-    int argCount = parseArgumentListExec(args);
-    expect(RPAREN);
-    if (foundIndex >= 0) {
-        int declared = (int)polyTable[foundIndex].params.size();
-        if (argCount != declared)
-            semErr4Lines.push_back(polyTok.line_no);
-    }
-    pe.args = args;
-    return pe;
 }
 
-int Parser::parseArgumentListExec(vector<PolyEvalArg>& args) {
-    int count = 0;
-    PolyEvalArg a = parseArgumentExec();
-    args.push_back(a);
-    count++;
-    Token t = peekToken();
-    while (t.token_type == COMMA) {
-        expect(COMMA);
-        PolyEvalArg a2 = parseArgumentExec();
-        args.push_back(a2);
-        count++;
-        t = peekToken();
+// Moves the arguments of a call from argStack to evalArgs and records it.
+int Parser::closePolyEvaluationExec(int polyIndex, int name, int line, size_t argBase) {
+    int argCount = (int)(argStack.size() - argBase);
+    if (polyIndex >= 0) {
+        int declared = (int)polyTable[polyIndex].params.size();
+        if (argCount != declared)
+            semErr4Lines.push_back(line);
     }
-    return count;
+    PolyEvalExec pe;
+    pe.polyIndex = polyIndex;
+    pe.name = name;
+    pe.line = line;
+    pe.firstArg = (int)evalArgs.size();
+    pe.numArgs = argCount;
+    evalArgs.insert(evalArgs.end(), argStack.begin() + argBase, argStack.end());
+    argStack.resize(argBase);
+    evals.push_back(pe);
+    return (int)evals.size() - 1;
 }
 
-PolyEvalArg Parser::parseArgumentExec() {
+// Pushes a number or variable argument on argStack. Returns false, without
+// consuming anything, when the argument is a nested evaluation.
+bool Parser::parseArgumentExec() {
     PolyEvalArg a;
     Token t = peekToken();
     if (t.token_type == NUM) {
         Token numTok = getNextToken();
         a.kind = ArgKind::NUM;
-        a.numValue = atoi(numTok.lexeme.c_str());
+        a.numValue = lexemeToLiteral(numTok.lexeme);
     } else if (t.token_type == ID) {
-        Token t2 = peekToken(2);
-        if (t2.token_type == LPAREN) {
-            a.kind = ArgKind::POLY_EVAL;
-            a.nested = parsePolyEvaluationExec();
-        } else {
-            Token varTok = getNextToken();
-            a.kind = ArgKind::VAR;
-            a.varName = varTok.lexeme;
-            getLocation(a.varName);
-            if (!initializedVars[a.varName])
-                uninitWarnLines.push_back(varTok.line_no);
-        }
+        if (peekToken(2).token_type == LPAREN)
+            return false;
+        Token varTok = getNextToken();
+        a.kind = ArgKind::VAR;
+        a.slot = slotOf(varTok.id);
+        a.line = varTok.line_no;
+        if (!initializedSlots[a.slot])
+            uninitWarnLines.push_back(varTok.line_no);
     } else {
         syntaxError();
     }
-    return a;
+    argStack.push_back(a);
+    return true;
 }
 
 //---------------------------------------
@@ -464,239 +705,1187 @@ void Parser::parseInputsSection() {
 //---------------------------------------
 // Semantic Error Check (Task 1)
 //---------------------------------------
-void Parser::checkSemanticErrors() {
-    if (!semErr1Lines.empty()) {
-        sort(semErr1Lines.begin(), semErr1Lines.end());
-        cout << "Semantic Error Code 1:";
-        for (int ln : semErr1Lines)
-            cout << " " << ln;
-        cout << endl;
-        exit(0);
-    }
-    if (!semErr2Lines.empty()) {
-        sort(semErr2Lines.begin(), semErr2Lines.end());
-        cout << "Semantic Error Code 2:";
-        for (int ln : semErr2Lines)
-            cout << " " << ln;
-        cout << endl;
-        exit(0);
-    }
-    if (!semErr3Lines.empty()) {
-        sort(semErr3Lines.begin(), semErr3Lines.end());
-        cout << "Semantic Error Code 3:";
-        for (int ln : semErr3Lines)
-            cout << " " << ln;
-        cout << endl;
-        exit(0);
-    }
-    if (!semErr4Lines.empty()) {
-        sort(semErr4Lines.begin(), semErr4Lines.end());
-        cout << "Semantic Error Code 4:";
-        for (int ln : semErr4Lines)
-            cout << " " << ln;
-        cout << endl;
-        exit(0);
+// Records the first kind of semantic error found, if any, with its sorted
+// lines; returns whether the program is free of them.
+bool Parser::checkSemanticErrors() {
+    std::vector<int> *found[] = { &semErr1Lines, &semErr2Lines, &semErr3Lines, &semErr4Lines };
+    for (int code = 1; code <= 4; code++) {
+        std::vector<int> &lines = *found[code - 1];
+        if (lines.empty())
+            continue;
+        sort(lines.begin(), lines.end());
+        semError.code = code;
+        semError.lines = lines;
+        return false;
     }
+    return true;
 }
 
 //---------------------------------------
-// Other Tasks Execution (Tasks 2-5)
+// Task 2: Execution & Evaluation
 //---------------------------------------
-void Parser::doOtherTasks() {
-    if (doTask2)
-        executeProgram();
-    if (doTask3)
-        printUninitializedWarnings();
-    if (doTask4) {
+int Parser::slotOf(int name) {
+    if (name >= (int)nameSlot.size())
+        nameSlot.resize(names.size(), -1);
+    if (nameSlot[name] < 0) {
+        nameSlot[name] = numSlots++;
+        initializedSlots.push_back(false);
+    }
+    return nameSlot[name];
+}
+
+template <class D>
+typename D::Value Parser::evalCall(const D &dom, int polyIndex,
+                                   const std::vector<typename D::Value> &args,
+                                   MemoCache<typename D::Value> *memo) const {
+    typename D::Value val;
+    if (memo && memo->find(polyIndex, args.data(), (int)args.size(), val))
+        return val;
+    // Native code exists only for the default domain
+    if constexpr (std::is_same<D, Wrap32>::value) {
+        JitFn fn = jitReady ? jit.function(polyIndex) : nullptr;
+        if (fn) {
+            val = fn(args.data());
+            if (options.jitVerify)
+                verifyJitResult(polyIndex, args, val);
+            if (memo)
+                memo->insert(polyIndex, args.data(), (int)args.size(), val);
+            return val;
+        }
+    }
+    val = evalPoly(dom, polyIndex, args);
+    if (memo)
+        memo->insert(polyIndex, args.data(), (int)args.size(), val);
+    return val;
+}
+
+// Differential check of the JIT (--jit-verify)
+void Parser::verifyJitResult(int polyIndex, const std::vector<int> &args, int nativeVal) const {
+    int interpVal = evalPoly(polyIndex, args);
+    if (interpVal == nativeVal)
+        return;
+    ostringstream msg;
+    msg << "JIT MISMATCH in " << names.name(polyTable[codePoly[polyIndex]].name) << "(";
+    for (size_t i = 0; i < args.size(); i++)
+        msg << (i ? ", " : "") << args[i];
+    msg << "): native " << nativeVal << ", interpreter " << interpVal;
+    throw VerifyError(msg.str());
+}
+
+// Runs the plan in the selected domain. Registers, memo caches and the
+// position in the inputs are all local to the run.
+RunResult Parser::run(const std::vector<__int128> &inputs) const {
+    RunResult result;
+    if (!planReady)
+        return result;
+    if (options.laneExec)
+        return runBatch({ inputs })[0];
+    try {
+        withDomain([&](const auto &dom) { runProgram(dom, inputs, result); });
+    } catch (const OverflowError &) {
+        result.status = PolyStatus::OVERFLOW_ERROR;
+    }
+    return result;
+}
+
+// Calls f with the numeric domain selected by the options.
+template <class F>
+void Parser::withDomain(F f) const {
+    switch (options.domain) {
+        case NumDomain::WRAP32:  f(Wrap32()); break;
+        case NumDomain::INT64:   f(Int64()); break;
+        case NumDomain::CHECKED: f(Checked64()); break;
+        case NumDomain::INT128:  f(Int128()); break;
+        case NumDomain::MOD:     f(ModPrime(options.modulus)); break;
+    }
+}
+
+// Runs once the program is known to be valid: lowers the EXECUTE section
+// and folds everything that does not depend on an INPUT.
+void Parser::partialEvaluate() {
+    preparePolynomials();
+    buildPlan();
+    if (options.fold)
+        withDomain([&](const auto &dom) { foldPlan(dom); });
+    planReady = true;
+}
+
+struct IntVectorHash {
+    size_t operator()(const std::vector<int> &v) const {
+        uint64_t h = v.size();
+        for (int x : v)
+            h = (h ^ (uint32_t)x) * 0x100000001b3ULL;
+        return (size_t)(h ^ (h >> 32));
+    }
+};
+
+struct PlanBuilder {
+    ExecPlan &plan;
+    bool share;                                       // Hash-cons constants and calls
+    std::vector<int> slotReg;                         // Current register of each variable
+    std::map<__int128, int> constReg;                 // Register holding each literal
+    std::unordered_map<std::vector<int>, int, IntVectorHash> callReg;  // (poly, arg registers)
+
+    PlanBuilder(ExecPlan &plan, bool share, int numSlots)
+        : plan(plan), share(share), slotReg(numSlots, -1) {}
+
+    int constant(__int128 value) {
+        if (share) {
+            auto it = constReg.find(value);
+            if (it != constReg.end())
+                return it->second;
+        }
+        PlanInstr in{PlanOp::CONST, plan.numRegs++};
+        in.value = value;
+        plan.code.push_back(in);
+        if (share)
+            constReg[value] = in.reg;
+        return in.reg;
+    }
+
+    // Variables that were never assigned read as 0.
+    int variable(int slot) {
+        return slotReg[slot] >= 0 ? slotReg[slot] : constant(0);
+    }
+};
+
+// Lowers the EXECUTE section to an ExecPlan. Every value gets its own
+// register, so a call is identified by its polynomial and the registers of
+// its arguments: reassigning a variable gives it a new register, and calls
+// made after that no longer match the earlier ones.
+//
+// Useless assignments are skipped: their values never reach an OUTPUT,
+// directly or through other assignments. In the checked domain they still
+// run, since one of them may be what overflows.
+void Parser::buildPlan() {
+    plan = ExecPlan();
+    PlanBuilder pb(plan, options.cse, numSlots);
+    bool dce = options.dce && options.domain != NumDomain::CHECKED;
+    if (dce)
         detectUselessAssignments();
-        printUselessAssignmentWarnings();
+    for (size_t i = 0; i < statements.size(); i++) {
+        const Statement &st = statements[i];
+        if (dce && !stmtLive[i] && st.type == StmtType::ASSIGN_STMT) {
+            plan.deadStatements++;
+            plan.deadCalls += countCalls(st);
+            continue;
+        }
+        if (st.type == StmtType::INPUT_STMT) {
+            PlanInstr in{PlanOp::INPUT, plan.numRegs++};
+            plan.code.push_back(in);
+            pb.slotReg[st.slot] = in.reg;
+        } else if (st.type == StmtType::OUTPUT_STMT) {
+            plan.code.push_back(PlanInstr{PlanOp::OUTPUT, pb.variable(st.slot)});
+        } else if (st.type == StmtType::ASSIGN_STMT) {
+            pb.slotReg[st.lhsSlot] = lowerEval(st, pb);
+        }
+    }
+}
+
+int Parser::countCalls(const Statement &st) {
+    int n = 0;
+    for (int e = st.firstEval; e <= st.rhsEval; e++) {
+        int poly = evals[e].polyIndex;
+        if (poly >= 0 && poly < (int)polyASTs.size())
+            n++;
+    }
+    return n;
+}
+
+// Emits the code for the right-hand side of st; returns the result
+// register. Nested evaluations come first in evals, so one pass in order
+// lowers every argument before the call that uses it.
+int Parser::lowerEval(const Statement &st, PlanBuilder &pb) {
+    std::vector<int> evalReg(st.rhsEval - st.firstEval + 1);
+    std::vector<int> key;
+    for (int e = st.firstEval; e <= st.rhsEval; e++) {
+        const PolyEvalExec &pe = evals[e];
+        int &result = evalReg[e - st.firstEval];
+        if (pe.polyIndex < 0 || pe.polyIndex >= (int)polyASTs.size()) {
+            result = pb.constant(0);
+            continue;
+        }
+        key.clear();
+        key.push_back(pe.polyIndex);
+        for (int i = 0; i < pe.numArgs; i++) {
+            const PolyEvalArg &A = evalArgs[pe.firstArg + i];
+            if (A.kind == ArgKind::NUM)
+                key.push_back(pb.constant(A.numValue));
+            else if (A.kind == ArgKind::VAR)
+                key.push_back(pb.variable(A.slot));
+            else
+                key.push_back(evalReg[A.eval - st.firstEval]);
+        }
+        plan.callSites++;
+        if (pb.share) {
+            auto it = pb.callReg.find(key);
+            if (it != pb.callReg.end()) {
+                plan.sharedCalls++;
+                result = it->second;
+                continue;
+            }
+        }
+        PlanInstr in{PlanOp::CALL, plan.numRegs++};
+        in.poly = pe.polyIndex;
+        in.firstArg = (int)plan.args.size();
+        in.numArgs = (int)key.size() - 1;
+        plan.args.insert(plan.args.end(), key.begin() + 1, key.end());
+        plan.code.push_back(in);
+        if (pb.share)
+            pb.callReg.emplace(key, in.reg);
+        result = in.reg;
+    }
+    return evalReg.back();
+}
+
+// The plan interpreter, instantiated once per numeric domain.
+template <class D>
+std::unique_ptr<MemoCache<typename D::Value>> Parser::makeMemo() const {
+    if (options.memoCapacity == 0)
+        return nullptr;
+    size_t maxArgs = 0;
+    for (auto &ph : polyTable)
+        maxArgs = std::max(maxArgs, ph.params.size());
+    return std::unique_ptr<MemoCache<typename D::Value>>(
+        new MemoCache<typename D::Value>(options.memoCapacity, (int)maxArgs));
+}
+
+template <class D>
+void Parser::runProgram(const D &dom, const std::vector<__int128> &inputs,
+                        RunResult &result) const {
+    std::vector<typename D::Value> regs(plan.numRegs, dom.fromInt(0));
+    std::vector<typename D::Value> argVals;
+    for (size_t i = 0; i < plan.constRegs.size(); i++)
+        regs[plan.constRegs[i]] = (typename D::Value)plan.constValues[i];
+    if (options.execThreads > 0) {
+        runPlanParallel(dom, inputs, regs, result);
+    } else {
+        std::unique_ptr<MemoCache<typename D::Value>> memo = makeMemo<D>();
+        size_t inputIndex = 0;
+        for (const PlanInstr &in : plan.code) {
+            switch (in.op) {
+                case PlanOp::INPUT:
+                    if (inputIndex < inputs.size())
+                        regs[in.reg] = dom.fromInt(inputs[inputIndex++]);
+                    else
+                        regs[in.reg] = dom.fromInt(0);
+                    break;
+                case PlanOp::OUTPUT:
+                    result.outputs.push_back((__int128)regs[in.reg]);
+                    break;
+                case PlanOp::CONST:
+                    regs[in.reg] = dom.fromInt(in.value);
+                    break;
+                case PlanOp::CALL:
+                    argVals.clear();
+                    for (int a = 0; a < in.numArgs; a++)
+                        argVals.push_back(regs[plan.args[in.firstArg + a]]);
+                    regs[in.reg] = evalCall(dom, in.poly, argVals, memo.get());
+                    break;
+            }
+        }
+        if (memo)
+            result.memo = memo->getStats();
+    }
+}
+
+// Runs the CALLs of the plan as a dependency graph on execThreads threads.
+// INPUTs and CONSTs are given their values first, so a CALL only waits for
+// the CALLs that compute its arguments. Each thread has its own memo
+// cache. The OUTPUTs are collected afterwards, in plan order. In the
+// checked domain an input or literal that does not fit, or an overflowing
+// CALL, poisons every CALL that depends on it, and the first poisoned
+// instruction in plan order is reported. A serial run would have stopped
+// at that point too, with the same outputs before it.
+template <class D>
+void Parser::runPlanParallel(const D &dom, const std::vector<__int128> &inputs,
+                             std::vector<typename D::Value> &regs, RunResult &result) const {
+    typedef typename D::Value Value;
+    std::vector<int> callInstr;                   // Plan position of each graph node
+    std::vector<int> producer(plan.numRegs, -1);  // Graph node computing each register
+    std::vector<char> poisoned(plan.numRegs, 0);
+    size_t inputIndex = 0;
+    for (size_t i = 0; i < plan.code.size(); i++) {
+        const PlanInstr &in = plan.code[i];
+        if (in.op == PlanOp::INPUT || in.op == PlanOp::CONST) {
+            __int128 literal = in.op == PlanOp::CONST ? in.value
+                             : inputIndex < inputs.size() ? inputs[inputIndex++] : 0;
+            try {
+                regs[in.reg] = dom.fromInt(literal);
+            } catch (const OverflowError &) {
+                poisoned[in.reg] = 1;
+            }
+        } else if (in.op == PlanOp::CALL) {
+            producer[in.reg] = (int)callInstr.size();
+            callInstr.push_back((int)i);
+        }
+    }
+    TaskGraph graph((int)callInstr.size());
+    for (size_t n = 0; n < callInstr.size(); n++) {
+        const PlanInstr &in = plan.code[callInstr[n]];
+        for (int a = 0; a < in.numArgs; a++) {
+            int from = producer[plan.args[in.firstArg + a]];
+            if (from >= 0)
+                graph.addEdge(from, (int)n);
+        }
+    }
+
+    ThreadPool pool(options.execThreads);
+    std::vector<std::unique_ptr<MemoCache<Value>>> memos(pool.size());
+    for (auto &m : memos)
+        m = makeMemo<D>();
+    std::vector<std::vector<Value>> argVals(pool.size());
+    std::exception_ptr failure;                   // First other error, e.g. VerifyError
+    std::mutex failureMutex;
+    graph.run(pool, [&](int node, int thread) {
+        const PlanInstr &in = plan.code[callInstr[node]];
+        std::vector<Value> &args = argVals[thread];
+        args.clear();
+        for (int a = 0; a < in.numArgs; a++) {
+            int r = plan.args[in.firstArg + a];
+            if (poisoned[r]) {
+                poisoned[in.reg] = 1;
+                return;
+            }
+            args.push_back(regs[r]);
+        }
+        try {
+            regs[in.reg] = evalCall(dom, in.poly, args, memos[thread].get());
+        } catch (const OverflowError &) {
+            poisoned[in.reg] = 1;
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(failureMutex);
+            if (!failure)
+                failure = std::current_exception();
+            poisoned[in.reg] = 1;
+        }
+    });
+    if (failure)
+        std::rethrow_exception(failure);
+
+    for (auto &m : memos) {
+        if (m) {
+            result.memo.hits += m->getStats().hits;
+            result.memo.misses += m->getStats().misses;
+            result.memo.evictions += m->getStats().evictions;
+        }
+    }
+    for (const PlanInstr &in : plan.code) {
+        if (in.op == PlanOp::OUTPUT)
+            result.outputs.push_back((__int128)regs[in.reg]);
+        else if (poisoned[in.reg])
+            checkedOverflow();
     }
-    if (doTask5)
-        printPolynomialDegrees();
 }
 
 //---------------------------------------
-// Task 2: Execution & Evaluation
+// Lane Execution (Task 2)
 //---------------------------------------
-static const int MEM_SIZE = 2000;
-static int memVar[MEM_SIZE];
+static const size_t EXEC_LANES = 16;   // Input sets per pass, one AVX-512 vector of ints
 
-int Parser::getLocation(const std::string &var) {
-    if (varLocation.find(var) == varLocation.end())
-        varLocation[var] = nextLoc++;
-    return varLocation[var];
+std::vector<RunResult> Parser::runBatch(const std::vector<std::vector<__int128>> &inputSets) const {
+    std::vector<RunResult> results(inputSets.size());
+    if (!planReady)
+        return results;
+    withDomain([&](const auto &dom) {
+        for (size_t first = 0; first < inputSets.size(); first += EXEC_LANES) {
+            size_t count = std::min(EXEC_LANES, inputSets.size() - first);
+            runLanes(dom, &inputSets[first], count, &results[first]);
+        }
+    });
+    return results;
 }
 
-int Parser::evalPolyEvalExec(const PolyEvalExec &pe) {
-    if (pe.polyIndex < 0 || pe.polyIndex >= (int)polyASTs.size())
-        return 0;
-    std::vector<int> argVals;
-    for (auto &A : pe.args) {
-        if (A.kind == ArgKind::NUM)
-            argVals.push_back(A.numValue);
-        else if (A.kind == ArgKind::VAR) {
-            int loc = getLocation(A.varName);
-            argVals.push_back(memVar[loc]);
+// Runs the plan once for count input sets side by side. Register r of
+// lane k is regs[r * count + k], so every instruction works on one row.
+// In the checked domain a lane whose input, literal or call overflows
+// stops there, with the outputs a serial run would have printed, and the
+// other lanes go on.
+template <class D>
+void Parser::runLanes(const D &dom, const std::vector<__int128> *inputSets, size_t count,
+                      RunResult *results) const {
+    typedef typename D::Value Value;
+    std::vector<Value> regs((size_t)plan.numRegs * count, dom.fromInt(0));
+    std::vector<size_t> inputIndex(count, 0);
+    std::vector<char> stopped(count, 0);
+    std::vector<const Value *> cols;
+    auto stopLane = [&](size_t k) {
+        if (!stopped[k]) {
+            stopped[k] = 1;
+            results[k].status = PolyStatus::OVERFLOW_ERROR;
         }
-        else {
-            int nestedVal = evalPolyEvalExec(A.nested);
-            argVals.push_back(nestedVal);
+    };
+    for (size_t i = 0; i < plan.constRegs.size(); i++)
+        std::fill_n(&regs[(size_t)plan.constRegs[i] * count], count, (Value)plan.constValues[i]);
+    for (const PlanInstr &in : plan.code) {
+        Value *row = &regs[(size_t)in.reg * count];
+        switch (in.op) {
+            case PlanOp::INPUT:
+                for (size_t k = 0; k < count; k++) {
+                    const std::vector<__int128> &inputs = inputSets[k];
+                    try {
+                        if (inputIndex[k] < inputs.size())
+                            row[k] = dom.fromInt(inputs[inputIndex[k]++]);
+                        else
+                            row[k] = dom.fromInt(0);
+                    } catch (const OverflowError &) {
+                        stopLane(k);
+                    }
+                }
+                break;
+            case PlanOp::OUTPUT:
+                for (size_t k = 0; k < count; k++) {
+                    if (!stopped[k])
+                        results[k].outputs.push_back((__int128)row[k]);
+                }
+                break;
+            case PlanOp::CONST:
+                try {
+                    std::fill_n(row, count, dom.fromInt(in.value));
+                } catch (const OverflowError &) {
+                    for (size_t k = 0; k < count; k++)
+                        stopLane(k);
+                }
+                break;
+            case PlanOp::CALL:
+                evalCallLanes(dom, in, regs.data(), count, cols, stopped, results);
+                break;
         }
     }
-    return evalPoly(pe.polyIndex, argVals);
 }
 
-void Parser::executeProgram() {
-    for (int i = 0; i < MEM_SIZE; i++)
-        memVar[i] = 0;
-    inputIndex = 0;
-    for (auto &st : statements) {
-        if (st.type == StmtType::INPUT_STMT) {
-            int loc = getLocation(st.varName);
-            if (inputIndex < (int)inputValues.size())
-                memVar[loc] = inputValues[inputIndex++];
-            else
-                memVar[loc] = 0;
-        } else if (st.type == StmtType::OUTPUT_STMT) {
-            int loc = getLocation(st.varName);
-            cout << memVar[loc] << endl;
-        } else if (st.type == StmtType::ASSIGN_STMT) {
-            int lhsLoc = getLocation(st.lhsVar);
-            int result = evalPolyEvalExec(st.rhsEval);
-            memVar[lhsLoc] = result;
+// One CALL for every lane. The argument registers are already rows, so
+// they are handed to the kernel as its columns without copying.
+template <class D>
+void Parser::evalCallLanes(const D &dom, const PlanInstr &in, typename D::Value *regs,
+                           size_t count, std::vector<const typename D::Value *> &cols,
+                           std::vector<char> &stopped, RunResult *results) const {
+    typedef typename D::Value Value;
+    Value *out = regs + (size_t)in.reg * count;
+    if (in.poly < 0 || in.poly >= (int)polyCode.size()) {
+        std::fill_n(out, count, dom.fromInt(0));
+        return;
+    }
+    const PolyCode &pc = polyCode[in.poly];
+    std::vector<Value> zeros;                     // Missing arguments read as 0
+    if (in.numArgs < pc.numParams)
+        zeros.assign(count, dom.fromInt(0));
+    cols.assign(std::max(in.numArgs, pc.numParams), zeros.data());
+    for (int a = 0; a < in.numArgs; a++)
+        cols[a] = regs + (size_t)plan.args[in.firstArg + a] * count;
+
+    if constexpr (std::is_same<D, Wrap32>::value) {
+        runPolyCodeBatch(pc, cols.data(), out, count);
+    } else {
+        try {
+            runPolyCodeLanes(dom, pc, cols.data(), out, count);
+            return;
+        } catch (const OverflowError &) {
+        }
+        // Some lane overflowed; find out which, one lane at a time
+        std::vector<Value> args(cols.size());
+        for (size_t k = 0; k < count; k++) {
+            if (stopped[k])
+                continue;
+            for (size_t i = 0; i < cols.size(); i++)
+                args[i] = cols[i][k];
+            try {
+                out[k] = runPolyCode(dom, pc, args.data());
+            } catch (const OverflowError &) {
+                stopped[k] = 1;
+                results[k].status = PolyStatus::OVERFLOW_ERROR;
+            }
         }
     }
 }
 
-int Parser::evalPoly(int polyIndex, const std::vector<int> &args) {
-    if (polyIndex < 0 || polyIndex >= (int)polyASTs.size())
-        return 0;
-    return evalNode(polyASTs[polyIndex], args);
-}
+static const int MAX_SPECIALIZATIONS = 4096;
 
-int Parser::evalNode(ASTNode* node, const std::vector<int> &args) {
-    if (!node)
-        return 0;
-    switch (node->kind) {
-        case NodeKind::TERM_LIST: {
-            int total = 0;
-            for (auto *ch : node->children) {
-                int val = evalNode(ch, args);
-                int sign = (ch->add_op == 0) ? 1 : ch->add_op;
-                total += sign * val;
+// Constant folding over the plan, in the domain execution will use. A
+// register is known when it holds a literal or a CALL whose arguments are
+// all known; such CALLs are evaluated now, and registers with equal known
+// values are merged so that calls on them are shared again. A CALL with
+// some known arguments runs a copy of the body specialized to them, if
+// that copy is shorter. In the checked domain a CALL that overflows is
+// left for execution, which reports the error at the same point.
+template <class D>
+void Parser::foldPlan(const D &dom) {
+    typedef typename D::Value Value;
+    ExecPlan out;
+    out.numRegs = plan.numRegs;
+    out.callSites = plan.callSites;
+    out.deadStatements = plan.deadStatements;
+    out.deadCalls = plan.deadCalls;
+    std::vector<int> repl(plan.numRegs);          // Register that holds each value
+    std::vector<char> known(plan.numRegs, 0);
+    std::vector<Value> value(plan.numRegs);
+    std::map<__int128, int> constReg;
+    std::unordered_map<std::vector<int>, int, IntVectorHash> callReg, specIndex;
+    std::vector<Value> argVals;
+    std::vector<int> key, specKey, constArgs;
+    std::vector<char> isConst;
+    int numSpecialized = 0;
+
+    auto setConstant = [&](int reg, Value v) {
+        auto it = constReg.find((__int128)v);
+        if (it != constReg.end()) {
+            repl[reg] = it->second;
+            return;
+        }
+        constReg.emplace((__int128)v, reg);
+        repl[reg] = reg;
+        known[reg] = 1;
+        value[reg] = v;
+        out.constRegs.push_back(reg);
+        out.constValues.push_back((__int128)v);
+    };
+
+    for (const PlanInstr &in : plan.code) {
+        if (in.op == PlanOp::CONST) {
+            try {
+                setConstant(in.reg, dom.fromInt(in.value));
+                continue;
+            } catch (const OverflowError &) {
+                // Left for execution, which reports it at this point
             }
-            return total;
         }
-        case NodeKind::TERM: {
-            int coeff = node->value;
-            if (!node->children.empty())
-                return coeff * evalNode(node->children[0], args);
+        if (in.op != PlanOp::CALL) {
+            PlanInstr copy = in;
+            if (in.op == PlanOp::OUTPUT)
+                copy.reg = repl[in.reg];
             else
-                return coeff;
-        }
-        case NodeKind::MONO_LIST: {
-            int product = 1;
-            for (auto *ch : node->children)
-                product *= evalNode(ch, args);
-            return product;
-        }
-        case NodeKind::MONO: {
-            int baseVal = evalNode(node->children[0], args);
-            int exp = node->value;
-            int res = 1;
-            for (int i = 0; i < exp; i++)
-                res *= baseVal;
-            return res;
-        }
-        case NodeKind::PRIMARY: {
-            if (node->paramIndex >= 0) {
-                if (node->paramIndex < (int)args.size())
-                    return args[node->paramIndex];
-                else
-                    return 0;
-            } else {
-                if (!node->children.empty())
-                    return evalNode(node->children[0], args);
-                return 0;
+                repl[in.reg] = in.reg;
+            out.code.push_back(copy);
+            continue;
+        }
+        // CALL: all arguments known -> evaluate now
+        bool allKnown = true, anyConst = false;
+        argVals.clear();
+        isConst.assign(in.numArgs, 0);
+        constArgs.assign(in.numArgs, 0);
+        for (int a = 0; a < in.numArgs; a++) {
+            int r = repl[plan.args[in.firstArg + a]];
+            allKnown = allKnown && known[r];
+            argVals.push_back(value[r]);
+            if (known[r] && dom.toInt(value[r], constArgs[a]))
+                isConst[a] = anyConst = 1;
+        }
+        if (allKnown) {
+            try {
+                setConstant(in.reg, evalPoly(dom, in.poly, argVals));
+                out.foldedCalls++;
+                continue;
+            } catch (const OverflowError &) {
+            }
+        }
+        // Some arguments known -> call a specialized body
+        int poly = in.poly;
+        if (anyConst && !allKnown) {
+            specKey.assign(1, poly);
+            for (int a = 0; a < in.numArgs; a++) {
+                specKey.push_back(isConst[a]);
+                specKey.push_back(isConst[a] ? constArgs[a] : 0);
+            }
+            auto it = specIndex.find(specKey);
+            int spec = -1;
+            if (it != specIndex.end()) {
+                spec = it->second;
+            } else if (numSpecialized < MAX_SPECIALIZATIONS) {
+                spec = specializePoly(dom, poly, isConst, constArgs);
+                numSpecialized += spec >= 0;
+                specIndex.emplace(specKey, spec);
+            }
+            if (spec >= 0)
+                poly = spec;
+            else
+                isConst.assign(in.numArgs, 0);
+        } else {
+            isConst.assign(in.numArgs, 0);
+        }
+        key.assign(1, poly);
+        for (int a = 0; a < in.numArgs; a++) {
+            if (!isConst[a])
+                key.push_back(repl[plan.args[in.firstArg + a]]);
+        }
+        if (options.cse) {
+            auto it = callReg.find(key);
+            if (it != callReg.end()) {
+                repl[in.reg] = it->second;
+                continue;
             }
+            callReg.emplace(key, in.reg);
+        }
+        repl[in.reg] = in.reg;
+        PlanInstr call{PlanOp::CALL, in.reg};
+        call.poly = poly;
+        call.firstArg = (int)out.args.size();
+        call.numArgs = (int)key.size() - 1;
+        out.args.insert(out.args.end(), key.begin() + 1, key.end());
+        out.code.push_back(call);
+        out.specializedCalls += poly != in.poly;
+    }
+    int liveCalls = 0;
+    for (const PlanInstr &in : out.code)
+        liveCalls += in.op == PlanOp::CALL;
+    out.sharedCalls = out.callSites - out.foldedCalls - liveCalls;
+    plan = std::move(out);
+}
+
+// Appends a copy of body polyIndex with the parameters marked in isConst
+// replaced by constArgs and the others renumbered in order. Returns its
+// index in polyCode, or -1 if folding did not make it shorter.
+template <class D>
+int Parser::specializePoly(const D &dom, int polyIndex, const std::vector<char> &isConst,
+                           const std::vector<int> &constArgs) {
+    const PolyCode &src = polyCode[polyIndex];
+    int numArgs = (int)isConst.size();
+    std::vector<int> newIndex(numArgs, -1);
+    for (int a = 0, k = 0; a < numArgs; a++) {
+        if (!isConst[a])
+            newIndex[a] = k++;
+    }
+    PolyCode spec;
+    for (const Instr &ins : src.code) {
+        if (ins.op != OpCode::LOAD_PARAM)
+            emitFolded(dom, spec, ins.op, ins.operand);
+        else if (ins.operand >= numArgs)
+            emitFolded(dom, spec, OpCode::LOAD_CONST, 0);   // missing arguments read as 0
+        else if (isConst[ins.operand])
+            emitFolded(dom, spec, OpCode::LOAD_CONST, constArgs[ins.operand]);
+        else
+            emitFolded(dom, spec, OpCode::LOAD_PARAM, newIndex[ins.operand]);
+    }
+    // In the default domain the canonical form can be specialized instead,
+    // which folds the constants into the coefficients
+    if (std::is_same<D, Wrap32>::value && polyIndex < (int)polyExpanded.size() &&
+        polyExpanded[polyIndex] && polySparse[polyIndex].numVars == numArgs) {
+        SparsePoly reduced;
+        PolyCode horner;
+        sparseSubstitute(polySparse[polyIndex], isConst, constArgs, reduced);
+        emitHorner(reduced, horner);
+        int hm = countMultiplies(horner), sm = countMultiplies(spec);
+        if (hm < sm || (hm == sm && horner.code.size() <= spec.code.size()))
+            spec = std::move(horner);
+    }
+    if (spec.code.size() >= src.code.size())
+        return -1;
+    int origin = codePoly[polyIndex];
+    polyCode.push_back(std::move(spec));
+    codePoly.push_back(origin);
+    return (int)polyCode.size() - 1;
+}
+
+// Builds the bytecode of every body the first time it is needed;
+// execution and batch evaluation share it.
+void Parser::preparePolynomials() {
+    if (polyPrepared)
+        return;
+    polyPrepared = true;
+    if (options.hornerEval && options.domain == NumDomain::WRAP32 &&
+        polyExpanded.size() != polyASTs.size())
+        expandPolynomials();
+    compilePolynomials();
+}
+
+// Expands every polynomial body into canonical sparse form. Bodies whose
+// expansion exceeds the term limits keep only their AST.
+void Parser::expandPolynomials() {
+    polySparse.assign(polyASTs.size(), SparsePoly());
+    polyExpanded.assign(polyASTs.size(), false);
+    for (size_t i = 0; i < polyASTs.size(); i++) {
+        int numVars = (int)polyTable[i].params.size();
+        polyExpanded[i] = expandNode(polyASTs[i], numVars, polySparse[i]);
+        if (polyExpanded[i])
+            polyTable[i].exactDegree = polySparse[i].degree();
+    }
+}
+
+// Builds the canonical form of root, combining children as the bytecode
+// of compileNode does. Nodes that are still waiting for children are kept
+// on an explicit stack, each with the value accumulated so far, so deeply
+// parenthesized bodies need no native stack.
+bool Parser::expandNode(int root, int numVars, SparsePoly &out) {
+    struct Frame {
+        int node;
+        int next;             // Next child to expand
+        SparsePoly value;     // Children before next combined
+    };
+    auto enter = [&](int node) {
+        const ASTNode &n = ast.nodes[node];
+        Frame f{node, 0, SparsePoly()};
+        if (n.kind == NodeKind::TERM)
+            f.value = SparsePoly::constant(numVars, n.value);
+        else if (n.kind == NodeKind::MONO_LIST)
+            f.value = SparsePoly::constant(numVars, 1);
+        else if (n.kind == NodeKind::PRIMARY && n.paramIndex >= 0 && n.paramIndex < numVars)
+            f.value = SparsePoly::variable(numVars, n.paramIndex);
+        else if (n.kind != NodeKind::MONO)
+            f.value = SparsePoly::constant(numVars, 0);
+        return f;
+    };
+    vector<Frame> stack;
+    stack.push_back(enter(root));
+    for (;;) {
+        Frame &f = stack.back();
+        const ASTNode &n = ast.nodes[f.node];
+        bool leaf = n.kind == NodeKind::PRIMARY && n.paramIndex >= 0;
+        if (!leaf && f.next < n.numChildren) {
+            int ch = ast.child(f.node, f.next++);
+            stack.push_back(enter(ch));
+            continue;
+        }
+        SparsePoly sub = std::move(f.value);
+        int child = f.node;
+        stack.pop_back();
+        if (stack.empty()) {
+            out = std::move(sub);
+            return true;
+        }
+        Frame &p = stack.back();
+        const ASTNode &pn = ast.nodes[p.node];
+        bool ok = true;
+        switch (pn.kind) {
+            case NodeKind::TERM_LIST:
+                ok = sparseAdd(p.value, sub, ast.nodes[child].add_op < 0 ? -1 : 1, p.value);
+                break;
+            case NodeKind::TERM:
+                ok = sparseMul(SparsePoly::constant(numVars, pn.value), sub, p.value);
+                break;
+            case NodeKind::MONO_LIST:
+                ok = sparseMul(p.value, sub, p.value);
+                break;
+            case NodeKind::MONO:
+                ok = sparsePow(sub, (int)pn.value, p.value);
+                break;
+            default:
+                p.value = std::move(sub);
+                break;
         }
+        if (!ok)
+            return false;
+    }
+}
+
+// Lowers every polynomial body to bytecode once, before execution starts.
+// When a canonical form is available its Horner code is used if it needs
+// fewer multiplications than the code that follows the body as written.
+// Canonical coefficients are only kept modulo 2^32, so the other domains
+// always run the body as written, in the interpreter.
+void Parser::compilePolynomials() {
+    bool wrap32 = options.domain == NumDomain::WRAP32;
+    polyCode.assign(polyASTs.size(), PolyCode());
+    codePoly.resize(polyASTs.size());
+    for (size_t i = 0; i < polyASTs.size(); i++) {
+        codePoly[i] = (int)i;
+        compileNode(polyCode[i], polyASTs[i]);
+        if (!options.hornerEval || !wrap32 || i >= polyExpanded.size() || !polyExpanded[i])
+            continue;
+        PolyCode horner;
+        emitHorner(polySparse[i], horner);
+        int hm = countMultiplies(horner), dm = countMultiplies(polyCode[i]);
+        if (hm < dm || (hm == dm && horner.code.size() <= polyCode[i].code.size()))
+            polyCode[i] = std::move(horner);
+    }
+}
+
+// Emits code that leaves the value of root on the stack: a term list adds
+// or subtracts its terms, a term multiplies its coefficient by its
+// monomials and a monomial raises its primary to its exponent. The walk
+// keeps its own stack of (node, step) pairs instead of recursing.
+void Parser::compileNode(PolyCode &pc, int root) {
+    vector<std::pair<int, int>> stack;
+    stack.push_back({root, 0});
+    while (!stack.empty()) {
+        int node = stack.back().first;
+        int step = stack.back().second++;
+        int child = compileStep(pc, node, step);
+        if (child >= 0)
+            stack.push_back({child, 0});
+        else
+            stack.pop_back();
+    }
+}
+
+// Emits the code of node that comes before its child number step (after
+// child step-1, if any) and returns that child, or emits the code that
+// follows the last child and returns -1.
+int Parser::compileStep(PolyCode &pc, int node, int step) {
+    const ASTNode &n = ast.nodes[node];
+    switch (n.kind) {
+        case NodeKind::TERM_LIST:
+            if (step > 0) {
+                bool minus = ast.nodes[ast.child(node, step - 1)].add_op < 0;
+                if (step > 1 || minus)
+                    pc.emit(minus ? OpCode::SUB : OpCode::ADD);
+            }
+            if (step < n.numChildren) {
+                int ch = ast.child(node, step);
+                if (step == 0 && ast.nodes[ch].add_op < 0)
+                    pc.emit(OpCode::LOAD_CONST, 0);
+                return ch;
+            }
+            return -1;
+        case NodeKind::TERM:
+            if (n.numChildren == 0 || n.value == 0) {
+                pc.emit(OpCode::LOAD_CONST, n.value);
+                return -1;
+            }
+            if (step == 0)
+                return ast.child(node, 0);
+            if (n.value != 1) {
+                pc.emit(OpCode::LOAD_CONST, n.value);
+                pc.emit(OpCode::MUL);
+            }
+            return -1;
+        case NodeKind::MONO_LIST:
+            if (step > 1)
+                pc.emit(OpCode::MUL);
+            return step < n.numChildren ? ast.child(node, step) : -1;
+        case NodeKind::MONO:
+            if (n.value <= 0) {
+                pc.emit(OpCode::LOAD_CONST, 1);
+                return -1;
+            }
+            if (step == 0)
+                return ast.child(node, 0);
+            if (n.value != 1)
+                pc.emit(OpCode::POW, n.value);
+            return -1;
+        case NodeKind::PRIMARY:
+            if (n.paramIndex >= 0)
+                pc.emit(OpCode::LOAD_PARAM, n.paramIndex);
+            else if (n.numChildren > 0 && step == 0)
+                return ast.child(node, 0);
+            else if (n.numChildren == 0)
+                pc.emit(OpCode::LOAD_CONST, 0);
+            return -1;
         default:
-            return 0;
+            pc.emit(OpCode::LOAD_CONST, 0);
+            return -1;
     }
 }
 
-//---------------------------------------
-// Task 3: Uninitialized Variable Warnings
-//---------------------------------------
-void Parser::printUninitializedWarnings() {
-    if (uninitWarnLines.empty())
+template <class D>
+typename D::Value Parser::evalPoly(const D &dom, int polyIndex,
+                                   const std::vector<typename D::Value> &args) const {
+    if (polyIndex < 0 || polyIndex >= (int)polyCode.size())
+        return dom.fromInt(0);
+    const PolyCode &pc = polyCode[polyIndex];
+    if ((int)args.size() < pc.numParams) {
+        std::vector<typename D::Value> padded(args);   // missing arguments read as 0
+        padded.resize(pc.numParams, dom.fromInt(0));
+        return runPolyCode(dom, pc, padded.data());
+    }
+    return runPolyCode(dom, pc, args.data());
+}
+
+int Parser::evalPoly(int polyIndex, const std::vector<int> &args) const {
+    return evalPoly(Wrap32(), polyIndex, args);
+}
+
+void Parser::evalPolyBatch(int polyIndex, const int *const *argColumns, int *results,
+                           size_t count, BatchKernel kernel) {
+    preparePolynomials();
+    if (polyIndex < 0 || polyIndex >= (int)polyCode.size()) {
+        std::fill(results, results + count, 0);
         return;
-    sort(uninitWarnLines.begin(), uninitWarnLines.end());
-    cout << "Warning Code 1:";
-    for (int ln : uninitWarnLines)
-        cout << " " << ln;
-    cout << endl;
+    }
+    runPolyCodeBatch(polyCode[polyIndex], argColumns, results, count, kernel);
+}
+
+// Differential check of the batch kernels (--batch-verify). Every
+// polynomial is evaluated at a fixed set of pseudo-random points with each
+// kernel the CPU supports; the point count leaves a scalar tail.
+void Parser::verifyBatchEvaluation() {
+    const size_t POINTS = 1003;
+    const BatchKernel kernels[] = { BatchKernel::SCALAR, BatchKernel::AVX2, BatchKernel::AVX512 };
+    const char *kernelNames[] = { "scalar", "avx2", "avx512" };
+    preparePolynomials();
+    uint32_t seed = 12345;
+    for (size_t p = 0; p < polyTable.size(); p++) {
+        size_t numArgs = std::max(polyTable[p].params.size(), (size_t)polyCode[p].numParams);
+        std::vector<std::vector<int>> columns(numArgs, std::vector<int>(POINTS));
+        std::vector<const int *> colPtrs(numArgs);
+        for (size_t i = 0; i < numArgs; i++) {
+            for (size_t k = 0; k < POINTS; k++) {
+                seed = seed * 1103515245u + 12345u;
+                // mostly small values, with full-range ones mixed in
+                columns[i][k] = (k & 3) ? (int)(seed >> 16) % 21 - 10 : (int)seed;
+            }
+            colPtrs[i] = columns[i].data();
+        }
+        std::vector<int> results(POINTS), args(numArgs);
+        for (size_t kn = 0; kn < 3; kn++) {
+            if (!batchKernelSupported(kernels[kn]))
+                continue;
+            evalPolyBatch((int)p, colPtrs.data(), results.data(), POINTS, kernels[kn]);
+            for (size_t k = 0; k < POINTS; k++) {
+                for (size_t i = 0; i < numArgs; i++)
+                    args[i] = columns[i][k];
+                int scalarVal = evalPoly((int)p, args);
+                if (results[k] == scalarVal)
+                    continue;
+                ostringstream msg;
+                msg << "BATCH MISMATCH (" << kernelNames[kn] << ") in "
+                    << names.name(polyTable[p].name) << "(";
+                for (size_t i = 0; i < numArgs; i++)
+                    msg << (i ? ", " : "") << args[i];
+                msg << "): batch " << results[k] << ", interpreter " << scalarVal;
+                throw VerifyError(msg.str());
+            }
+        }
+    }
 }
 
 //---------------------------------------
 // Task 4: Useless Assignment Warnings
 //---------------------------------------
-void Parser::collectVarsInPolyEvalExec(const PolyEvalExec &pe, std::unordered_map<std::string, bool> &live) {
-    for (auto &A : pe.args) {
-        if (A.kind == ArgKind::VAR)
-            live[A.varName] = true;
-        else if (A.kind == ArgKind::POLY_EVAL)
-            collectVarsInPolyEvalExec(A.nested, live);
+void Parser::collectVarsInPolyEvalExec(const Statement &st, std::vector<char> &live) {
+    for (int e = st.firstEval; e <= st.rhsEval; e++) {
+        const PolyEvalExec &pe = evals[e];
+        for (int i = 0; i < pe.numArgs; i++) {
+            const PolyEvalArg &A = evalArgs[pe.firstArg + i];
+            if (A.kind == ArgKind::VAR)
+                live[A.slot] = true;
+        }
     }
 }
 
+// Backward liveness over the statements. Also records in stmtLive which
+// statements are useful; execution leaves the useless assignments out.
 void Parser::detectUselessAssignments() {
-    std::unordered_map<std::string, bool> live;
+    if (stmtLive.size() == statements.size() && !statements.empty())
+        return;
+    std::vector<char> live(numSlots, false);
+    stmtLive.assign(statements.size(), 1);
     for (int i = (int)statements.size() - 1; i >= 0; i--) {
         Statement &st = statements[i];
         if (st.type == StmtType::OUTPUT_STMT) {
-            live[st.varName] = true;
+            live[st.slot] = true;
         } else if (st.type == StmtType::ASSIGN_STMT) {
-            if (!live[st.lhsVar])
+            if (!live[st.lhsSlot]) {
                 uselessWarnLines.push_back(st.line);
-            else {
-                live.erase(st.lhsVar);
-                collectVarsInPolyEvalExec(st.rhsEval, live);
+                stmtLive[i] = 0;
+            } else {
+                live[st.lhsSlot] = false;
+                collectVarsInPolyEvalExec(st, live);
             }
         } else if (st.type == StmtType::INPUT_STMT) {
-            if (!live[st.varName])
+            if (!live[st.slot]) {
                 uselessWarnLines.push_back(st.line);
-            else
-                live.erase(st.varName);
+                stmtLive[i] = 0;
+            } else {
+                live[st.slot] = false;
+            }
         }
     }
 }
 
-void Parser::printUselessAssignmentWarnings() {
-    if (uselessWarnLines.empty())
-        return;
-    sort(uselessWarnLines.begin(), uselessWarnLines.end());
-    cout << "Warning Code 2:";
-    for (int ln : uselessWarnLines)
-        cout << " " << ln;
-    cout << endl;
-}
-
 //---------------------------------------
-// Task 5: Print Polynomial Degrees
+// Task 5: Polynomial Degrees
 //---------------------------------------
-void Parser::printPolynomialDegrees() {
+std::vector<PolyDegree> Parser::degrees() const {
+    std::vector<PolyDegree> result;
+    result.reserve(polyTable.size());
     for (auto &ph : polyTable) {
-        cout << ph.name << ": " << ph.degree << endl;
+        long long d = options.exactDegree && ph.exactDegree >= 0 ? ph.exactDegree : ph.degree;
+        result.push_back({ std::string(names.name(ph.name)), d });
     }
+    return result;
+}
+
+PlanStats Parser::planStats() const {
+    PlanStats st;
+    st.callSites = plan.callSites;
+    st.sharedCalls = plan.sharedCalls;
+    st.deadStatements = plan.deadStatements;
+    st.deadCalls = plan.deadCalls;
+    st.foldedCalls = plan.foldedCalls;
+    st.specializedCalls = plan.specializedCalls;
+    return st;
 }
 
 //---------------------------------------
-// Main (always included for autograder)
+// Compiled Program Cache
 //---------------------------------------
-int main() {
-    LexicalAnalyzer lexer;
-    Parser parser(lexer);
-    parser.parseProgram();
-    return 0;
-}
\ No newline at end of file
+void Parser::saveCompiled(BlobWriter &out) const {
+    uint8_t tasks = doTask1 | doTask2 << 1 | doTask3 << 2 | doTask4 << 3 | doTask5 << 4;
+    out.pod(tasks);
+    out.pod(semError.code);
+    out.vec(semError.lines);
+    out.vec(inputValues);
+    out.vec(uninitWarnLines);
+    out.vec(uselessWarnLines);
+    out.pod((uint64_t)polyTable.size());
+    for (const PolyHeader &ph : polyTable) {
+        out.str(names.name(ph.name));
+        out.pod((uint64_t)ph.params.size());
+        out.pod(ph.degree);
+        out.pod(ph.exactDegree);
+    }
+    out.pod((uint8_t)planReady);
+    if (!planReady)
+        return;
+    out.pod((uint64_t)polyCode.size());
+    for (const PolyCode &pc : polyCode) {
+        out.vec(pc.code);
+        out.pod(pc.maxStack);
+        out.pod(pc.numParams);
+        out.pod(pc.depth);
+    }
+    out.vec(codePoly);
+    out.vec(plan.code);
+    out.vec(plan.args);
+    out.pod(plan.numRegs);
+    out.vec(plan.constRegs);
+    out.vec(plan.constValues);
+    int counts[] = { plan.callSites, plan.sharedCalls, plan.foldedCalls,
+                     plan.specializedCalls, plan.deadStatements, plan.deadCalls };
+    out.pod(counts);
+}
+
+// Whether loaded bytecode is what PolyCode::emit would have built: known
+// opcodes, int parameter indices and exponents, no pop from an empty
+// stack, and the recorded stack depths and parameter count equal to the
+// ones the code implies. runPolyCode and the JIT size their stacks and
+// read arguments by these fields.
+static bool polyCodeValid(const PolyCode &pc) {
+    int depth = 0, maxStack = 0, numParams = 0;
+    for (const Instr &in : pc.code) {
+        switch (in.op) {
+            case OpCode::LOAD_PARAM:
+                if (in.operand < 0 || in.operand >= INT_MAX)
+                    return false;
+                numParams = std::max(numParams, (int)in.operand + 1);
+                depth++;
+                break;
+            case OpCode::LOAD_CONST:
+                depth++;
+                break;
+            case OpCode::ADD:
+            case OpCode::SUB:
+            case OpCode::MUL:
+                if (depth < 2)
+                    return false;
+                depth--;
+                break;
+            case OpCode::POW:
+                if (depth < 1 || in.operand < 0 || in.operand > INT_MAX)
+                    return false;
+                break;
+            default:
+                return false;
+        }
+        maxStack = std::max(maxStack, depth);
+    }
+    return depth == pc.depth && depth <= 1 && maxStack == pc.maxStack &&
+           numParams == pc.numParams;
+}
+
+// Whether every index in a loaded plan is in range and every body is well
+// formed, so that a damaged entry cannot send execution outside its arrays.
+bool Parser::planIndicesValid() const {
+    for (const PolyCode &pc : polyCode) {
+        if (!polyCodeValid(pc))
+            return false;
+    }
+    auto isReg = [&](int r) { return r >= 0 && r < plan.numRegs; };
+    for (const PlanInstr &in : plan.code) {
+        if (!isReg(in.reg))
+            return false;
+        if (in.op == PlanOp::CALL &&
+            (in.poly < 0 || in.poly >= (int)polyCode.size() || in.firstArg < 0 ||
+             in.numArgs < 0 || (size_t)in.firstArg + in.numArgs > plan.args.size() ||
+             in.numArgs < polyCode[in.poly].numParams))
+            return false;
+    }
+    for (int r : plan.args) {
+        if (!isReg(r))
+            return false;
+    }
+    for (int r : plan.constRegs) {
+        if (!isReg(r))
+            return false;
+    }
+    if (plan.constValues.size() != plan.constRegs.size() || codePoly.size() != polyCode.size())
+        return false;
+    for (int p : codePoly) {
+        if (p < 0 || p >= (int)polyTable.size())
+            return false;
+    }
+    // A declaration's own body loads none but its declared parameters
+    for (size_t i = 0; i < polyTable.size() && i < polyCode.size(); i++) {
+        if (polyCode[i].numParams > (int)polyTable[i].params.size())
+            return false;
+    }
+    return true;
+}
+
+// Parameter names are not kept, only their number; nothing after
+// compilation looks at them.
+bool Parser::loadCompiled(BlobReader &in) {
+    uint8_t tasks = 0;
+    uint64_t numPolys = 0;
+    in.pod(tasks);
+    in.pod(semError.code);
+    in.vec(semError.lines);
+    in.vec(inputValues);
+    in.vec(uninitWarnLines);
+    in.vec(uselessWarnLines);
+    doTask1 = tasks & 1;
+    doTask2 = tasks & 2;
+    doTask3 = tasks & 4;
+    doTask4 = tasks & 8;
+    doTask5 = tasks & 16;
+    if (!in.pod(numPolys) || numPolys > (uint64_t)(in.end - in.p))
+        return false;
+    polyTable.resize(numPolys);
+    std::string name;
+    for (PolyHeader &ph : polyTable) {
+        uint64_t numParams = 0;
+        in.str(name);
+        in.pod(numParams);
+        in.pod(ph.degree);
+        in.pod(ph.exactDegree);
+        if (!in.ok || numParams > (uint64_t)INT_MAX)
+            return false;
+        ph.name = names.intern(name);
+        ph.params.assign(numParams, -1);
+        ph.line = 0;
+    }
+    uint8_t ready = 0;
+    in.pod(ready);
+    planReady = ready;
+    if (!planReady)
+        return in.ok;
+    uint64_t numCodes = 0;
+    if (!in.pod(numCodes) || numCodes > (uint64_t)(in.end - in.p))
+        return false;
+    polyCode.resize(numCodes);
+    for (PolyCode &pc : polyCode) {
+        in.vec(pc.code);
+        in.pod(pc.maxStack);
+        in.pod(pc.numParams);
+        in.pod(pc.depth);
+    }
+    in.vec(codePoly);
+    in.vec(plan.code);
+    in.vec(plan.args);
+    in.pod(plan.numRegs);
+    in.vec(plan.constRegs);
+    in.vec(plan.constValues);
+    int counts[6] = {};
+    in.pod(counts);
+    plan.callSites = counts[0];
+    plan.sharedCalls = counts[1];
+    plan.foldedCalls = counts[2];
+    plan.specializedCalls = counts[3];
+    plan.deadStatements = counts[4];
+    plan.deadCalls = counts[5];
+    if (!in.ok || !planIndicesValid())
+        return false;
+    polyPrepared = true;
+    if (options.jit && options.domain == NumDomain::WRAP32)
+        jitReady = jit.compile(polyCode);
+    return true;
+}
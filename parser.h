@@ -1,10 +1,17 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <unordered_map>
 #include "lexer.h"
+#include "intern.h"
+#include "polyvm.h"
+#include "sparsepoly.h"
+#include "polyjit.h"
+#include "memocache.h"
+#include "polyparser.h"
 
 ///---------------------------------------------------------
 /// Data Structures for Polynomial Declarations (Tasks 1 & 5)
@@ -12,11 +19,13 @@
 
 /// Represents a polynomial declaration, storing its name, parameters, 
 /// the line number where it was first declared, and its computed degree.
+/// Names are ids in the lexer's NameTable.
 struct PolyHeader {
-    std::string name;
-    std::vector<std::string> params; // Parameter names
+    int name;                        // Polynomial name id
+    std::vector<int> params;         // Parameter name ids
     int line;                        // First declaration line
     int degree;                      // Computed polynomial degree
+    long long exactDegree = -1;      // Degree after expansion; -1 if not expanded
 };
 
 ///---------------------------------------------------------
@@ -26,15 +35,47 @@ struct PolyHeader {
 /// Enumeration for different node types in the AST.
 enum class NodeKind { TERM_LIST, TERM, MONO_LIST, MONO, PRIMARY, NONE };
 
-/// Represents a node in the AST for polynomial expressions.
+/// Represents a node in the AST for polynomial expressions. Nodes live in
+/// an ASTArena and name their children as a contiguous index range.
 struct ASTNode {
-    NodeKind kind;                  // Type of AST node
-    int value;                       // Coefficient or exponent value
+    NodeKind kind;                   // Type of AST node
+    __int128 value;                  // Coefficient (as written) or exponent value
     int add_op;                      // +1 for plus, -1 for minus, 0 if none
     int paramIndex;                  // Index of parameter if PRIMARY node; -1 otherwise
-    std::vector<ASTNode*> children;  // Child nodes
+    int firstChild;                  // Start of child range in ASTArena::children
+    int numChildren;                 // Number of child nodes
 
-    ASTNode() : kind(NodeKind::NONE), value(0), add_op(0), paramIndex(-1) {}
+    ASTNode() : kind(NodeKind::NONE), value(0), add_op(0), paramIndex(-1),
+                firstChild(0), numChildren(0) {}
+};
+
+/// Owns every AST node of a program. Nodes and child index ranges are
+/// appended to two flat arrays, so building a node is a bump allocation,
+/// siblings are adjacent in memory, and teardown frees two blocks no
+/// matter how many polynomials were parsed.
+struct ASTArena {
+    std::vector<ASTNode> nodes;      // Node storage; nodes are referred to by index
+    std::vector<int> children;       // Child node indices, one range per parent
+
+    int newNode(NodeKind kind) {
+        nodes.emplace_back();
+        nodes.back().kind = kind;
+        return (int)nodes.size() - 1;
+    }
+    int child(int node, int i) const { return children[nodes[node].firstChild + i]; }
+
+    /// Copies the nodes of other to nodes[nodeBase ..] and their child
+    /// ranges to children[childBase ..], shifting its node indices by
+    /// nodeBase. Both arrays must already be large enough.
+    void place(const ASTArena &other, int nodeBase, int childBase) {
+        for (size_t i = 0; i < other.nodes.size(); i++) {
+            ASTNode n = other.nodes[i];
+            n.firstChild += childBase;
+            nodes[nodeBase + i] = n;
+        }
+        for (size_t i = 0; i < other.children.size(); i++)
+            children[childBase + i] = other.children[i] + nodeBase;
+    }
 };
 
 ///---------------------------------------------------------
@@ -44,13 +85,16 @@ struct ASTNode {
 /// Enumeration of different statement types in the EXECUTE section.
 enum class StmtType { INPUT_STMT, OUTPUT_STMT, ASSIGN_STMT };
 
-/// Forward declaration for polynomial evaluation structure.
-struct PolyEvalArg;
-
-/// Represents the evaluation of a polynomial during execution.
+/// Represents the evaluation of a polynomial during execution. Evaluations
+/// live in Parser::evals and their arguments in Parser::evalArgs, in the
+/// order they are closed, so a nested evaluation always comes before the
+/// one it is an argument of.
 struct PolyEvalExec {
     int polyIndex;                 // Index in polyTable (-1 if not found)
-    std::vector<PolyEvalArg> args; // Arguments for evaluation
+    int name = -1;                 // Polynomial name id
+    int line = 0;
+    int firstArg = 0;              // Arguments are evalArgs[firstArg .. firstArg+numArgs)
+    int numArgs = 0;
 };
 
 /// Enumeration for different kinds of evaluation arguments.
@@ -59,22 +103,104 @@ enum class ArgKind { VAR, NUM, POLY_EVAL };
 /// Represents an argument in a polynomial evaluation.
 struct PolyEvalArg {
     ArgKind kind;               // Type of argument
-    std::string varName;        // Variable name (if kind == VAR)
-    int numValue;               // Numeric value (if kind == NUM)
-    PolyEvalExec nested;        // Nested polynomial evaluation (if kind == POLY_EVAL)
+    int slot;                   // Variable slot (if kind == VAR)
+    __int128 numValue;          // Literal as written (if kind == NUM)
+    int eval;                   // Nested evaluation in evals (if kind == POLY_EVAL)
+    int line;                   // Line of the variable (if kind == VAR)
 
-    PolyEvalArg() : kind(ArgKind::VAR), numValue(0) {}
+    PolyEvalArg() : kind(ArgKind::VAR), slot(-1), numValue(0), eval(-1), line(0) {}
 };
 
 /// Represents a single statement in the program (input, output, or assignment).
 struct Statement {
     StmtType type;            // Type of statement
     int line;                 // Line number of the statement
-    std::string varName;      // Used for INPUT/OUTPUT statements
-    std::string lhsVar;       // Left-hand side variable in ASSIGN statements
-    PolyEvalExec rhsEval;     // Right-hand side evaluation in ASSIGN statements
+    int slot = -1;            // Variable slot for INPUT/OUTPUT statements
+    int lhsSlot = -1;         // Left-hand side variable slot in ASSIGN statements
+    int firstEval = 0;        // Evaluations of the right-hand side of an ASSIGN are
+    int rhsEval = -1;         // evals[firstEval .. rhsEval], rhsEval being the outermost
+};
+
+///---------------------------------------------------------
+/// Execution Plan (Task 2)
+///---------------------------------------------------------
+
+/// Operations of the lowered EXECUTE section.
+enum class PlanOp { INPUT, OUTPUT, CONST, CALL };
+
+/// One step of the plan. Registers are written once: a variable is just a
+/// name for the register that holds its current value, so assignments
+/// need no instruction of their own.
+struct PlanInstr {
+    PlanOp op;
+    int reg;                  // Register written (INPUT, CONST, CALL) or printed (OUTPUT)
+    int poly = -1;            // Polynomial of a CALL
+    int firstArg = 0;         // CALL arguments are ExecPlan::args[firstArg .. firstArg+numArgs)
+    int numArgs = 0;
+    __int128 value = 0;       // Literal of a CONST, as written
+};
+
+/// The EXECUTE section as straight-line register code, in statement order.
+struct ExecPlan {
+    std::vector<PlanInstr> code;
+    std::vector<int> args;    // Argument registers of every CALL
+    int numRegs = 0;
+    std::vector<int> constRegs;           // Registers filled before execution
+    std::vector<__int128> constValues;    // Their values, in the domain of the plan
+    int callSites = 0;        // Polynomial evaluations in the source
+    int sharedCalls = 0;      // Of those, answered by an earlier identical CALL
+    int foldedCalls = 0;      // Of those, computed before execution
+    int specializedCalls = 0; // CALLs of a body specialized to constant arguments
+    int deadStatements = 0;   // Assignments left out because they are useless
+    int deadCalls = 0;        // Polynomial evaluations in those assignments
 };
 
+///---------------------------------------------------------
+/// Units of an Edited Program (PolySession)
+///---------------------------------------------------------
+
+/// Section a unit starts in. The first unit holds the TASKS section and
+/// the first declaration; the unit that holds EXECUTE ends in EXEC.
+enum class UnitSection { START, POLY, EXEC };
+
+/// A name in a unit and the line it is on, counted from the unit's first
+/// line as 1. For a polynomial evaluation, numArgs is its argument count.
+struct UnitName {
+    int name = -1;
+    int line = 0;
+    int numArgs = 0;
+};
+
+/// What Parser::parseUnit finds in one unit. Names are ids in the lexer's
+/// NameTable.
+struct ParsedUnit {
+    std::vector<int> tasks;            // Tasks requested
+    std::vector<__int128> inputs;      // The INPUTS numbers
+
+    // A declaration
+    bool isDecl = false;
+    UnitName decl;
+    int numParams = 0;
+    long long degree = 0;              // After like terms cancel, when expanded
+    std::vector<int> badNameLines;     // Semantic Error 2
+
+    // A statement
+    bool isStmt = false;
+    StmtType stmtType = StmtType::INPUT_STMT;
+    UnitName var;                      // Read, written or assigned
+    std::vector<UnitName> calls;
+    std::vector<UnitName> reads;       // Variables passed as arguments
+};
+
+/// Lowering state used while building an ExecPlan.
+struct PlanBuilder;
+
+struct BlobWriter;
+struct BlobReader;
+
+/// Thrown by the parser on the first syntax error.
+struct SyntaxError {};
+
 ///---------------------------------------------------------
 /// Parser Class Declaration
 ///---------------------------------------------------------
@@ -83,11 +209,61 @@ struct Statement {
 /// execution statements, and error detection.
 class Parser {
 public:
-    Parser(LexicalAnalyzer &lexer);
-    void parseProgram();
+    Parser(LexicalAnalyzer &lexer, const ParserOptions &options = ParserOptions());
+
+    /// Parses and checks the program and, when Task 2 is requested,
+    /// prepares its execution plan. Throws SyntaxError; a semantic error
+    /// is recorded in semanticError and ends compilation.
+    void compile();
+    /// Parses the tokens of one unit of an edited program, which starts
+    /// in section, with the productions compile() uses, and summarizes it
+    /// in unit. Throws SyntaxError unless the unit is exactly one
+    /// declaration or statement (with the TASKS section before the first
+    /// declaration and EXECUTE before the first statement) or the INPUTS
+    /// section.
+    void parseUnit(UnitSection section, ParsedUnit &unit);
+    /// Runs the execution plan with the given INPUTS numbers. Touches no
+    /// parser state, so several runs may go on at once.
+    RunResult run(const std::vector<__int128> &inputs) const;
+    /// Runs the plan once per input set, in groups of EXEC_LANES sets
+    /// whose registers are stored lane by lane. Calls are evaluated by the
+    /// batch kernels (32-bit domain) or runPolyCodeLanes; the memo cache
+    /// and the JIT are not used.
+    std::vector<RunResult> runBatch(const std::vector<std::vector<__int128>> &inputSets) const;
+
+    /// Results of compile()
+    const SemanticError &semanticError() const { return semError; }
+    bool hasTask(int n) const;
+    const std::vector<__int128> &inputs() const { return inputValues; }
+    const std::vector<int> &uninitializedWarnings() const { return uninitWarnLines; }
+    const std::vector<int> &uselessWarnings() const { return uselessWarnLines; }
+    std::vector<PolyDegree> degrees() const;
+    PlanStats planStats() const;
+
+    /// Writes what run() and the accessors above need to out, after
+    /// compile(). loadCompiled reads it back in place of compile(),
+    /// interning the polynomial names; it returns false on a damaged blob.
+    void saveCompiled(BlobWriter &out) const;
+    bool loadCompiled(BlobReader &in);
+
+    /// Checks the batch kernels against the interpreter on pseudo-random
+    /// points; throws VerifyError on a difference.
+    void verifyBatchEvaluation();
+
+    /// Evaluates polynomial polyIndex at count points. argColumns holds one
+    /// column per parameter (argument i of point k is argColumns[i][k]) and
+    /// results receives one value per point, as evalPoly would compute it.
+    void evalPolyBatch(int polyIndex, const int *const *argColumns, int *results,
+                       size_t count, BatchKernel kernel = BatchKernel::AUTO);
 
 private:
+    /// Parser for the declarations in tokens[0 .. count) on a worker thread.
+    Parser(const Parser &parent, const Token *tokens, size_t count);
+
     LexicalAnalyzer &lexer;
+    ParserOptions options;
+    NameTable &names;         // Interned identifiers shared with the lexer
+    int implicitParam;        // Id of "x", the parameter of headers without a list
 
     /// Task flags (set in TASKS section)
     bool doTask1 = false; // Always performed internally
@@ -104,27 +280,66 @@ private:
 
     /// Storage for polynomial declarations and their AST representations (Tasks 1 & 5)
     std::vector<PolyHeader> polyTable;    // List of declared polynomials
-    std::vector<ASTNode*> polyASTs;       // ASTs for polynomial bodies
-    std::vector<std::string> currentPolyParams; // Active parameters while parsing a polynomial
+    ASTArena ast;                         // Storage for all polynomial ASTs
+    std::vector<int> polyASTs;            // Root node of each polynomial body
+    std::vector<int> childStack;          // Children of nodes under construction
+    std::vector<PolyCode> polyCode;       // Bytecode of each polynomial body, then
+                                          // of the specialized bodies
+    std::vector<int> codePoly;            // Polynomial each polyCode entry evaluates
+    std::vector<SparsePoly> polySparse;   // Canonical form of each polynomial body
+    std::vector<bool> polyExpanded;       // Whether the canonical form fit the limits
+    PolyJit jit;                          // Native code for polyCode (options.jit)
+    bool jitReady = false;
+    bool polyPrepared = false;            // polyCode (and jit) have been built
+    std::vector<int> currentPolyParams;   // Active parameters while parsing a polynomial
+
+    /// Symbol tables indexed by interned name id (Task 1)
+    std::vector<int> namePoly;            // Index in polyTable of each declared name, or -1
+    std::vector<int> nameParam;           // Position in currentPolyParams, or -1
+    int findPoly(int name) const;
+    int findParam(int name) const;
+    void setCurrentParams(const std::vector<int> &params);
+
+    /// Parallel parsing of the POLY section. A worker parses a run of
+    /// whole declarations from its own token range into its own arena and
+    /// keeps them in parsedDecls; the main parser then declares them in
+    /// order, so duplicates are found exactly as in a serial parse.
+    struct ParsedDecl {
+        PolyHeader header;
+        int root;                         // Body in the worker's arena
+        int degree;
+    };
+    const Token *chunkTokens = nullptr;   // Token range of a worker, else null
+    size_t chunkPos = 0;
+    size_t chunkEnd = 0;
+    std::vector<ParsedDecl> parsedDecls;
 
     /// Statement list for execution (Tasks 2, 3, 4)
     std::vector<Statement> statements;
+    std::vector<PolyEvalExec> evals;      // Every polynomial evaluation, innermost first
+    std::vector<PolyEvalArg> evalArgs;    // Their arguments
+    std::vector<PolyEvalArg> argStack;    // Arguments of evaluations under construction
 
-    /// Input value storage (Task 2)
-    std::vector<int> inputValues;
-    int inputIndex = 0;
+    /// Input value storage (Task 2), as written
+    std::vector<__int128> inputValues;
 
     /// Uninitialized variable tracking (Task 3)
     std::vector<int> uninitWarnLines;
-    std::unordered_map<std::string, bool> initializedVars;
+    std::vector<char> initializedSlots;
+
+    /// Lowered EXECUTE section (Task 2)
+    ExecPlan plan;
+    bool planReady = false;
 
-    /// Variable memory allocation (Task 2)
-    std::unordered_map<std::string, int> varLocation;
-    int nextLoc = 0;
-    int getLocation(const std::string &var);
+    /// Variables of the EXECUTE section, numbered densely in order of
+    /// first appearance; everything after parsing indexes by slot.
+    std::vector<int> nameSlot;            // Slot of each interned name, -1 if none
+    int numSlots = 0;
+    int slotOf(int name);
 
     /// Warnings for useless assignments (Task 4)
     std::vector<int> uselessWarnLines;
+    std::vector<char> stmtLive;           // Per statement: its result can reach an OUTPUT
 
     /// Helper functions for token handling
     Token getNextToken();
@@ -135,19 +350,21 @@ private:
     /// Parsing routines for program structure
     void parseTasksSection();
     void parseNumList(std::vector<int>& numList);
+    void parseNumList(std::vector<__int128>& numList);
     void parsePolySection();
     void parsePolyDeclList();
+    void parsePolyDeclListParallel();
     void parsePolyDecl();
-    void parsePolyHeader();
-    void parseIdList(std::vector<std::string>& params);
+    PolyHeader parsePolyHeader();
+    void declarePoly(PolyHeader &&ph, int root, int degree);
+    void parseIdList(std::vector<int>& params);
     void parsePolyBody();
 
     /// AST construction for polynomial expressions (Task 5)
-    ASTNode* parseTermListNode(int &outDegree);
-    ASTNode* parseTermNode(int &outDegree);
-    ASTNode* parseMonomialListNode(int &outDegree);
-    ASTNode* parseMonomialNode(int &outDegree);
-    ASTNode* parsePrimaryNode(int &outDegree);
+    int parseTermListNode(int &outDegree);
+    int parsePrimaryId();
+    void setChildren(int node, size_t stackBase);
+    void setChild(int node, int child);
     int parseExponent();
 
     /// Parsing routines for EXECUTE section (Tasks 2, 3, 4)
@@ -157,26 +374,57 @@ private:
     Statement parseInputStatement();
     Statement parseOutputStatement();
     Statement parseAssignStatement();
-    PolyEvalExec parsePolyEvaluationExec();
-    int parseArgumentListExec(std::vector<PolyEvalArg>& args);
-    PolyEvalArg parseArgumentExec();
+    int parsePolyEvaluationExec();
+    bool parseArgumentExec();
+    int closePolyEvaluationExec(int polyIndex, int name, int line, size_t argBase);
 
     void parseInputsSection();
 
     /// Semantic error detection (Task 1)
-    void checkSemanticErrors();
+    SemanticError semError;
+    bool checkSemanticErrors();
 
     /// Execution tasks (Tasks 2-5)
-    void doOtherTasks();
-    void executeProgram();
-    int evalPoly(int polyIndex, const std::vector<int>& args);
-    int evalNode(ASTNode* node, const std::vector<int>& args);
-    int evalPolyEvalExec(const PolyEvalExec &pe);
-    void printUninitializedWarnings();
+    void preparePolynomials();
+    void expandPolynomials();
+    bool expandNode(int root, int numVars, SparsePoly &out);
+    void compilePolynomials();
+    void compileNode(PolyCode &pc, int root);
+    int compileStep(PolyCode &pc, int node, int step);
+    void partialEvaluate();
+    template <class F> void withDomain(F f) const;
+    void buildPlan();
+    int lowerEval(const Statement &st, PlanBuilder &pb);
+    int countCalls(const Statement &st);
+    template <class D> void foldPlan(const D &dom);
+    template <class D>
+    int specializePoly(const D &dom, int polyIndex, const std::vector<char> &isConst,
+                       const std::vector<int> &constArgs);
+    template <class D>
+    void runProgram(const D &dom, const std::vector<__int128> &inputs, RunResult &result) const;
+    template <class D>
+    void runPlanParallel(const D &dom, const std::vector<__int128> &inputs,
+                         std::vector<typename D::Value> &regs, RunResult &result) const;
+    template <class D>
+    void runLanes(const D &dom, const std::vector<__int128> *inputSets, size_t count,
+                  RunResult *results) const;
+    template <class D>
+    void evalCallLanes(const D &dom, const PlanInstr &in, typename D::Value *regs, size_t count,
+                       std::vector<const typename D::Value *> &cols,
+                       std::vector<char> &stopped, RunResult *results) const;
+    template <class D> std::unique_ptr<MemoCache<typename D::Value>> makeMemo() const;
+    template <class D>
+    typename D::Value evalCall(const D &dom, int polyIndex,
+                               const std::vector<typename D::Value> &args,
+                               MemoCache<typename D::Value> *memo) const;
+    template <class D>
+    typename D::Value evalPoly(const D &dom, int polyIndex,
+                               const std::vector<typename D::Value> &args) const;
+    int evalPoly(int polyIndex, const std::vector<int>& args) const;
+    void verifyJitResult(int polyIndex, const std::vector<int>& args, int nativeVal) const;
     void detectUselessAssignments();
-    void collectVarsInPolyEvalExec(const PolyEvalExec &pe, std::unordered_map<std::string, bool> &live);
-    void printUselessAssignmentWarnings();
-    void printPolynomialDegrees();
+    void collectVarsInPolyEvalExec(const Statement &st, std::vector<char> &live);
+    bool planIndicesValid() const;
 };
 
 #endif
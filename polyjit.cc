@@ -0,0 +1,162 @@
+#include "polyjit.h"
+
+#if defined(__x86_64__) && defined(__unix__)
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cstring>
+#define POLYJIT_X86_64 1
+#endif
+
+using namespace std;
+
+static const int MAX_JIT_STACK = 4096;   // Operand stack slots kept on the machine stack
+
+PolyJit::~PolyJit() {
+#ifdef POLYJIT_X86_64
+    if (region != nullptr)
+        munmap(region, regionSize);
+#endif
+}
+
+bool PolyJit::supported() {
+#ifdef POLYJIT_X86_64
+    return true;
+#else
+    return false;
+#endif
+}
+
+#ifdef POLYJIT_X86_64
+
+//---------------------------------------
+// Machine Code Emission
+//---------------------------------------
+namespace {
+class Emitter {
+public:
+    vector<uint8_t> &out;
+    explicit Emitter(vector<uint8_t> &out) : out(out) {}
+
+    void bytes(std::initializer_list<uint8_t> bs) { out.insert(out.end(), bs); }
+    void imm32(int32_t v) {
+        for (int i = 0; i < 4; i++)
+            out.push_back((uint8_t)((uint32_t)v >> (8 * i)));
+    }
+
+    void pushRax()         { bytes({0x50}); }                  // push rax
+    void popRcx()          { bytes({0x59}); }                  // pop rcx
+    void movEaxImm(int v)  { bytes({0xB8}); imm32(v); }        // mov eax, imm32
+    void movEaxArg(int i)  { bytes({0x8B, 0x87}); imm32(4 * i); } // mov eax, [rdi + 4i]
+    void addEaxEcx()       { bytes({0x01, 0xC8}); }            // add eax, ecx
+    void subEcxEax()       { bytes({0x29, 0xC1}); }            // sub ecx, eax
+    void movEaxEcx()       { bytes({0x89, 0xC8}); }            // mov eax, ecx
+    void movEcxEax()       { bytes({0x89, 0xC1}); }            // mov ecx, eax
+    void imulEaxEcx()      { bytes({0x0F, 0xAF, 0xC1}); }      // imul eax, ecx
+    void imulEcxEcx()      { bytes({0x0F, 0xAF, 0xC9}); }      // imul ecx, ecx
+    void xorEaxEax()       { bytes({0x31, 0xC0}); }            // xor eax, eax
+    void ret()             { bytes({0xC3}); }                  // ret
+};
+}
+
+// eax holds the top of the operand stack; a load first saves the old top.
+static void emitBody(const PolyCode &pc, vector<uint8_t> &out) {
+    Emitter e(out);
+    int depth = 0;
+    for (const Instr &in : pc.code) {
+        switch (in.op) {
+            case OpCode::LOAD_PARAM:
+            case OpCode::LOAD_CONST:
+                if (depth++ > 0)
+                    e.pushRax();
+                if (in.op == OpCode::LOAD_PARAM)
+                    e.movEaxArg((int)in.operand);
+                else
+                    e.movEaxImm(Wrap32().fromInt(in.operand));
+                break;
+            case OpCode::ADD:
+                e.popRcx();
+                e.addEaxEcx();
+                depth--;
+                break;
+            case OpCode::SUB:
+                e.popRcx();
+                e.subEcxEax();
+                e.movEaxEcx();
+                depth--;
+                break;
+            case OpCode::MUL:
+                e.popRcx();
+                e.imulEaxEcx();
+                depth--;
+                break;
+            case OpCode::POW: {
+                // unrolled repeated squaring on the constant exponent
+                int exp = (int)in.operand;
+                if (exp <= 0) {
+                    e.movEaxImm(1);
+                    break;
+                }
+                e.movEcxEax();
+                bool first = true;
+                while (exp > 0) {
+                    if (exp & 1) {
+                        if (first)
+                            e.movEaxEcx();
+                        else
+                            e.imulEaxEcx();
+                        first = false;
+                    }
+                    exp >>= 1;
+                    if (exp > 0)
+                        e.imulEcxEcx();
+                }
+                break;
+            }
+        }
+    }
+    if (depth == 0)
+        e.xorEaxEax();
+    e.ret();
+}
+
+bool PolyJit::compile(const vector<PolyCode> &bodies) {
+    vector<uint8_t> text;
+    vector<long> offsets(bodies.size(), -1);
+    for (size_t i = 0; i < bodies.size(); i++) {
+        if (bodies[i].maxStack > MAX_JIT_STACK)
+            continue;
+        while (text.size() % 16 != 0)
+            text.push_back(0xCC);               // int3 padding between functions
+        offsets[i] = (long)text.size();
+        emitBody(bodies[i], text);
+    }
+    if (text.empty())
+        return false;
+
+    long page = sysconf(_SC_PAGESIZE);
+    size_t size = (text.size() + page - 1) / page * page;
+    void *mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+        return false;
+    memcpy(mem, text.data(), text.size());
+    if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mem, size);
+        return false;
+    }
+    region = mem;
+    regionSize = size;
+    fns.assign(bodies.size(), nullptr);
+    for (size_t i = 0; i < bodies.size(); i++) {
+        if (offsets[i] >= 0)
+            fns[i] = (JitFn)((uint8_t *)mem + offsets[i]);
+    }
+    return true;
+}
+
+#else
+
+bool PolyJit::compile(const vector<PolyCode> &) {
+    return false;
+}
+
+#endif
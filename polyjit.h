@@ -0,0 +1,44 @@
+#ifndef POLYJIT_H
+#define POLYJIT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "polyvm.h"
+
+///---------------------------------------------------------
+/// x86-64 JIT for Polynomial Bytecode (Task 2)
+///---------------------------------------------------------
+
+/// A compiled polynomial: takes the argument array, returns the value with
+/// the same 32-bit wrapping results as runPolyCode.
+typedef int (*JitFn)(const int *args);
+
+/// Translates bytecode to native code in one executable mapping. The top
+/// of the operand stack lives in eax and the rest on the machine stack,
+/// so each bytecode instruction becomes a few machine instructions.
+class PolyJit {
+public:
+    PolyJit() = default;
+    ~PolyJit();
+    PolyJit(const PolyJit&) = delete;
+    PolyJit& operator=(const PolyJit&) = delete;
+
+    /// Whether native code can be generated on this platform.
+    static bool supported();
+
+    /// Compiles every body. Bodies too deep for the machine stack get no
+    /// function and must be interpreted. Returns false if nothing could be
+    /// compiled (unsupported platform or no executable memory).
+    bool compile(const std::vector<PolyCode> &bodies);
+
+    /// The native function for body i, or nullptr.
+    JitFn function(int i) const { return i < (int)fns.size() ? fns[i] : nullptr; }
+
+private:
+    void *region = nullptr;
+    size_t regionSize = 0;
+    std::vector<JitFn> fns;
+};
+
+#endif
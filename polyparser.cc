@@ -0,0 +1,118 @@
+#include "polyparser.h"
+#include "inputbuf.h"
+#include "parser.h"
+#include "progcache.h"
+
+using namespace std;
+
+//---------------------------------------
+// PolyProgram
+//---------------------------------------
+PolyProgram::PolyProgram(const char *data, size_t len, const ParserOptions &options)
+    : text(data, len) {
+    input.reset(new InputBuffer(text.data(), text.size()));
+    open(false, SCAN_AUTO, options);
+}
+
+PolyProgram::PolyProgram(unique_ptr<InputBuffer> in, bool streamTokens, ScanMode scan,
+                         const ParserOptions &options)
+    : input(move(in)) {
+    open(streamTokens, scan, options);
+}
+
+PolyProgram::~PolyProgram() = default;
+
+// Only a program whose whole text is at hand can be looked up. A hit
+// builds a lexer that never reads (a streaming one) for the parser's name
+// table and loads the parser from the entry. A miss compiles as usual and
+// stores the result. --batch-verify needs the polynomial ASTs, which are
+// not cached.
+void PolyProgram::open(bool streamTokens, ScanMode scan, const ParserOptions &options) {
+    if (options.cacheDir.empty() || !input->HasSpan() || options.batchVerify) {
+        lexer.reset(new LexicalAnalyzer(*input, streamTokens, scan));
+        compile(options);
+        return;
+    }
+    ProgramCache cache(options.cacheDir);
+    CacheKey key = cacheKey(input->Data() + input->Pos(), input->Size() - input->Pos(), options);
+    const char *blob;
+    size_t len;
+    if (cache.lookup(key, blob, len)) {
+        lexer.reset(new LexicalAnalyzer(*input, true, scan));
+        parser.reset(new Parser(*lexer, options));
+        BlobReader in(blob, len);
+        uint8_t status = 0;
+        if (in.pod(status) && status <= (uint8_t)PolyStatus::SEMANTIC_ERROR &&
+            (status == (uint8_t)PolyStatus::SYNTAX_ERROR || parser->loadCompiled(in))) {
+            compileStatus = (PolyStatus)status;
+            cached = true;
+            return;
+        }
+    }
+    lexer.reset(new LexicalAnalyzer(*input, streamTokens, scan));
+    compile(options);
+    BlobWriter out;
+    out.pod((uint8_t)compileStatus);
+    if (compileStatus != PolyStatus::SYNTAX_ERROR)
+        parser->saveCompiled(out);
+    cache.store(key, out.data);
+}
+
+// Everything the program can report is decided here; run() only reads
+// the parser.
+void PolyProgram::compile(const ParserOptions &options) {
+    parser.reset(new Parser(*lexer, options));
+    try {
+        parser->compile();
+    } catch (const SyntaxError &) {
+        compileStatus = PolyStatus::SYNTAX_ERROR;
+        return;
+    }
+    if (parser->semanticError().code != 0)
+        compileStatus = PolyStatus::SEMANTIC_ERROR;
+}
+
+const SemanticError &PolyProgram::semanticError() const {
+    return parser->semanticError();
+}
+
+bool PolyProgram::hasTask(int n) const {
+    return compileStatus == PolyStatus::OK && parser->hasTask(n);
+}
+
+const vector<__int128> &PolyProgram::inputs() const {
+    return parser->inputs();
+}
+
+const vector<int> &PolyProgram::uninitializedWarnings() const {
+    return parser->uninitializedWarnings();
+}
+
+const vector<int> &PolyProgram::uselessWarnings() const {
+    return parser->uselessWarnings();
+}
+
+vector<PolyDegree> PolyProgram::degrees() const {
+    return parser->degrees();
+}
+
+PlanStats PolyProgram::planStats() const {
+    return parser->planStats();
+}
+
+RunResult PolyProgram::run(const vector<__int128> &inputs) const {
+    if (compileStatus != PolyStatus::OK)
+        return RunResult();
+    return parser->run(inputs);
+}
+
+vector<RunResult> PolyProgram::runBatch(const vector<vector<__int128>> &inputSets) const {
+    if (compileStatus != PolyStatus::OK)
+        return vector<RunResult>(inputSets.size());
+    return parser->runBatch(inputSets);
+}
+
+void PolyProgram::verifyBatch() {
+    if (compileStatus == PolyStatus::OK)
+        parser->verifyBatchEvaluation();
+}
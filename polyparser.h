@@ -0,0 +1,155 @@
+#ifndef POLYPARSER_H
+#define POLYPARSER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "lexer.h"
+#include "numdomain.h"
+#include "memocache.h"
+
+///---------------------------------------------------------
+/// Parser Options
+///---------------------------------------------------------
+
+/// Evaluation and reporting choices made on the command line.
+struct ParserOptions {
+    bool hornerEval = true;    // Evaluate expanded polynomials with Horner's scheme
+    bool exactDegree = false;  // Task 5 reports degrees after like terms cancel
+    bool jit = false;          // Run polynomial bodies as native code when possible
+    bool jitVerify = false;    // Check every native result against the interpreter
+    bool batchVerify = false;  // Check the batch kernels against the interpreter
+    NumDomain domain = NumDomain::WRAP32;  // Arithmetic of EXECUTE statements
+    uint64_t modulus = 0;      // Modulus of NumDomain::MOD
+    size_t memoCapacity = 0;   // Entries of the evaluation memo cache, 0 for none
+    bool stats = false;        // Report execution statistics on stderr
+    bool cse = true;           // Evaluate identical calls on the same values once
+    bool fold = true;          // Evaluate constant calls before execution
+    bool dce = true;           // Skip assignments whose results are never output
+    int polyThreads = 0;       // Threads parsing the POLY section, 0 to parse it serially
+    int execThreads = 0;       // Threads running the plan as a graph, 0 to run it in order
+    bool laneExec = false;     // run() goes through runBatch with a single input set
+    std::string cacheDir;      // Directory of compiled programs, empty for no cache
+};
+
+///---------------------------------------------------------
+/// Results
+///---------------------------------------------------------
+
+/// How compiling or running a program ended.
+enum class PolyStatus { OK, SYNTAX_ERROR, SEMANTIC_ERROR, OVERFLOW_ERROR };
+
+/// The semantic error reported by Task 1: its code (1 to 4, 0 if none)
+/// and the sorted lines it was found on.
+struct SemanticError {
+    int code = 0;
+    std::vector<int> lines;
+};
+
+/// Degree of one polynomial as Task 5 reports it.
+struct PolyDegree {
+    std::string name;
+    long long degree;
+};
+
+/// What the optimizations did to the EXECUTE section.
+struct PlanStats {
+    int callSites = 0;        // Polynomial evaluations in the source
+    int sharedCalls = 0;      // Answered by an earlier identical call
+    int deadStatements = 0;   // Useless assignments left out
+    int deadCalls = 0;        // Evaluations inside them
+    int foldedCalls = 0;      // Evaluated before execution
+    int specializedCalls = 0; // Running a body specialized to constant arguments
+};
+
+/// One execution of a program. Values are given in a type wide enough for
+/// every numeric domain.
+struct RunResult {
+    PolyStatus status = PolyStatus::OK;   // OK or OVERFLOW_ERROR
+    std::vector<__int128> outputs;        // One value per OUTPUT reached, in order
+    MemoStats memo;                       // Counters of the memo caches, if enabled
+};
+
+/// Thrown by the self checks (--jit-verify, --batch-verify) when the
+/// evaluators disagree; the message names the polynomial and arguments.
+class VerifyError : public std::runtime_error {
+public:
+    explicit VerifyError(const std::string &message) : std::runtime_error(message) {}
+};
+
+///---------------------------------------------------------
+/// Library Interface
+///---------------------------------------------------------
+
+class InputBuffer;
+class LexicalAnalyzer;
+class Parser;
+
+/// A compiled program. Constructing one lexes, parses and checks the
+/// program and prepares it for execution, or loads all of that from the
+/// compiled program cache when options.cacheDir is set; nothing is printed and the
+/// process is never exited, every outcome is returned as data. A compiled
+/// program may be run any number of times, from several threads at once,
+/// and programs are independent of each other.
+class PolyProgram {
+public:
+    /// Compiles the program text data[0 .. len), which is copied.
+    PolyProgram(const char *data, size_t len, const ParserOptions &options = ParserOptions());
+    /// Compiles the program read from input, tokenized on demand when
+    /// streamTokens is set.
+    PolyProgram(std::unique_ptr<InputBuffer> input, bool streamTokens, ScanMode scan,
+                const ParserOptions &options = ParserOptions());
+    ~PolyProgram();
+
+    PolyProgram(const PolyProgram &) = delete;
+    PolyProgram &operator=(const PolyProgram &) = delete;
+
+    /// OK, SYNTAX_ERROR or SEMANTIC_ERROR; only an OK program has results.
+    PolyStatus status() const { return compileStatus; }
+    /// Whether the program was loaded from options.cacheDir instead of
+    /// being lexed and parsed.
+    bool fromCache() const { return cached; }
+    const SemanticError &semanticError() const;
+
+    /// Whether the TASKS section lists task n.
+    bool hasTask(int n) const;
+    /// The numbers of the INPUTS section, as written (saturated to
+    /// __int128); the numeric domain converts them when the program runs.
+    const std::vector<__int128> &inputs() const;
+
+    /// Sorted lines of Warning Code 1 (Task 3) and Warning Code 2 (Task 4).
+    const std::vector<int> &uninitializedWarnings() const;
+    const std::vector<int> &uselessWarnings() const;
+    /// Degrees of the polynomials in declaration order (Task 5).
+    std::vector<PolyDegree> degrees() const;
+    PlanStats planStats() const;
+
+    /// Runs the EXECUTE section with the given INPUTS numbers. Programs
+    /// whose TASKS do not list 2 have no plan and produce no outputs.
+    RunResult run(const std::vector<__int128> &inputs) const;
+    RunResult run() const { return run(inputs()); }
+    /// Runs the EXECUTE section once per input set, giving one result per
+    /// set. The sets go through the plan 16 at a time, one lane each, so
+    /// every instruction is dispatched once per group of sets.
+    std::vector<RunResult> runBatch(const std::vector<std::vector<__int128>> &inputSets) const;
+
+    /// Checks the batch kernels against the interpreter on pseudo-random
+    /// points; throws VerifyError on a difference.
+    void verifyBatch();
+
+private:
+    std::string text;                         // Copy of the source, if one was given
+    std::unique_ptr<InputBuffer> input;
+    std::unique_ptr<LexicalAnalyzer> lexer;
+    std::unique_ptr<Parser> parser;
+    PolyStatus compileStatus = PolyStatus::OK;
+    bool cached = false;
+
+    void open(bool streamTokens, ScanMode scan, const ParserOptions &options);
+    void compile(const ParserOptions &options);
+};
+
+#endif
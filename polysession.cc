@@ -0,0 +1,707 @@
+#include "polysession.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include "inputbuf.h"
+#include "lexer.h"
+#include "parser.h"
+
+using namespace std;
+
+//---------------------------------------
+// Units
+//---------------------------------------
+
+// A node of an implicit treap: a unit's place in the text is its place in
+// an in-order walk, and every node keeps the bytes, newlines and units of
+// its subtree.
+struct SessionUnit {
+    std::string text;
+    size_t newlines = 0;
+    UnitSection startSection = UnitSection::START;
+    UnitSection endSection = UnitSection::START;
+    bool valid = false;
+    ParsedUnit parsed;                 // Names are session ids
+    bool live = false;                 // An assignment whose value reaches an OUTPUT
+    uint64_t label = 0;                // Increasing in text order
+
+    SessionUnit *left = nullptr;
+    SessionUnit *right = nullptr;
+    SessionUnit *parent = nullptr;
+    unsigned priority = 0;             // Larger than those of the children
+    size_t bytes = 0;                  // Of the subtree
+    size_t lines = 0;
+    size_t count = 1;
+};
+
+static size_t countOf(const SessionUnit *u) { return u != nullptr ? u->count : 0; }
+static size_t bytesOf(const SessionUnit *u) { return u != nullptr ? u->bytes : 0; }
+static size_t linesOf(const SessionUnit *u) { return u != nullptr ? u->lines : 0; }
+
+static void update(SessionUnit *u) {
+    u->bytes = u->text.size() + bytesOf(u->left) + bytesOf(u->right);
+    u->lines = u->newlines + linesOf(u->left) + linesOf(u->right);
+    u->count = 1 + countOf(u->left) + countOf(u->right);
+    if (u->left != nullptr)
+        u->left->parent = u;
+    if (u->right != nullptr)
+        u->right->parent = u;
+}
+
+// The tree is balanced by its random priorities, so the recursion below
+// is logarithmic in the number of units.
+static SessionUnit *merge(SessionUnit *a, SessionUnit *b) {
+    if (a == nullptr || b == nullptr)
+        return a != nullptr ? a : b;
+    if (a->priority > b->priority) {
+        a->right = merge(a->right, b);
+        update(a);
+        return a;
+    }
+    b->left = merge(a, b->left);
+    update(b);
+    return b;
+}
+
+// Splits t into its first k units and the others.
+static void split(SessionUnit *t, size_t k, SessionUnit *&a, SessionUnit *&b) {
+    if (t == nullptr) {
+        a = b = nullptr;
+        return;
+    }
+    if (countOf(t->left) < k) {
+        split(t->right, k - countOf(t->left) - 1, t->right, b);
+        a = t;
+        update(a);
+    } else {
+        split(t->left, k, a, t->left);
+        b = t;
+        update(b);
+    }
+    if (a != nullptr)
+        a->parent = nullptr;
+    if (b != nullptr)
+        b->parent = nullptr;
+}
+
+static void destroy(SessionUnit *t) {
+    vector<SessionUnit *> stack;
+    if (t != nullptr)
+        stack.push_back(t);
+    while (!stack.empty()) {
+        SessionUnit *u = stack.back();
+        stack.pop_back();
+        if (u->left != nullptr)
+            stack.push_back(u->left);
+        if (u->right != nullptr)
+            stack.push_back(u->right);
+        delete u;
+    }
+}
+
+static SessionUnit *leftmost(SessionUnit *u) {
+    while (u->left != nullptr)
+        u = u->left;
+    return u;
+}
+
+static SessionUnit *rightmost(SessionUnit *u) {
+    while (u->right != nullptr)
+        u = u->right;
+    return u;
+}
+
+static SessionUnit *successor(SessionUnit *u) {
+    if (u->right != nullptr)
+        return leftmost(u->right);
+    while (u->parent != nullptr && u == u->parent->right)
+        u = u->parent;
+    return u->parent;
+}
+
+static SessionUnit *predecessor(SessionUnit *u) {
+    if (u->left != nullptr)
+        return rightmost(u->left);
+    while (u->parent != nullptr && u == u->parent->left)
+        u = u->parent;
+    return u->parent;
+}
+
+// Units before u in the text.
+static size_t indexOf(const SessionUnit *u) {
+    size_t i = countOf(u->left);
+    for (; u->parent != nullptr; u = u->parent) {
+        if (u == u->parent->right)
+            i += countOf(u->parent->left) + 1;
+    }
+    return i;
+}
+
+// Newlines before u in the text.
+static size_t linesBefore(const SessionUnit *u) {
+    size_t n = linesOf(u->left);
+    for (; u->parent != nullptr; u = u->parent) {
+        if (u == u->parent->right)
+            n += linesOf(u->parent->left) + u->parent->newlines;
+    }
+    return n;
+}
+
+static bool unitBefore(const SessionUnit *a, const SessionUnit *b) {
+    return a->label < b->label;
+}
+
+bool PolySession::TextOrder::operator()(const Occ &a, const Occ &b) const {
+    if (a.unit == b.unit)
+        return a.line < b.line;
+    return a.unit->label < b.unit->label;
+}
+
+// Labels are kept in 1 << LABEL_BITS values. A range of 1 << i labels may
+// hold up to (2 / LABEL_DENSITY)^i units, so the ranges around a crowded
+// spot are relabeled less often the larger they are.
+static const int LABEL_BITS = 62;
+static const double LABEL_DENSITY = 1.4;
+
+// Gives the count units from first on labels between those of the units
+// around them. Where there is no room, the smallest aligned range of
+// labels around them that is sparse enough is spread out evenly over its
+// units and the new ones, which keeps their order; each unit is relabeled
+// O(log n) times over the edits, amortized.
+static void labelUnits(SessionUnit *first, size_t count) {
+    SessionUnit *from = first, *lo = predecessor(first), *hi = first;
+    for (size_t k = 0; k < count; k++)
+        hi = successor(hi);
+    uint64_t base = lo != nullptr ? lo->label : 0;
+    size_t total = count;
+    int i = 1;
+    for (;; i++) {
+        uint64_t start = base >> i << i, end = start + ((uint64_t)1 << i);
+        for (; lo != nullptr && lo->label >= start; lo = predecessor(lo)) {
+            from = lo;
+            total++;
+        }
+        for (; hi != nullptr && hi->label < end; hi = successor(hi))
+            total++;
+        if (i == LABEL_BITS || total <= ldexp(1.0, i) / pow(LABEL_DENSITY, i))
+            break;
+    }
+    uint64_t start = base >> i << i, gap = ((uint64_t)1 << i) / total;
+    for (size_t k = 0; from != hi; from = successor(from))
+        from->label = start + k++ * gap;
+}
+
+//---------------------------------------
+// Names
+//---------------------------------------
+
+// The places are in text order; a declaration, assignment or OUTPUT is at
+// the line of its name, a call at that of the polynomial name and a use as
+// an argument at that of the variable.
+struct PolySession::NameInfo {
+    std::string text;
+    int refs = 0;                      // Mentions in the summaries of valid units
+    OccSet decls;
+    std::map<int, OccSet> calls;       // By argument count
+    size_t numCalls = 0;
+    OccSet defs;                       // INPUT statements and assignments
+    OccSet uses;                       // OUTPUT statements and arguments
+    OccSet liveUses;                   // Of those, the ones that reach an OUTPUT
+    size_t errs[4] = {};               // Lines of Semantic Errors 1, 3 and 4
+    SessionUnit *firstDecl = nullptr;
+};
+
+int PolySession::acquire(string_view name) {
+    auto it = nameIds.find(string(name));
+    if (it != nameIds.end()) {
+        nameInfo[it->second].refs++;
+        return it->second;
+    }
+    int id;
+    if (!freeNames.empty()) {
+        id = freeNames.back();
+        freeNames.pop_back();
+    } else {
+        id = (int)nameInfo.size();
+        nameInfo.emplace_back();
+    }
+    nameInfo[id].text = string(name);
+    nameInfo[id].refs = 1;
+    nameIds.emplace(nameInfo[id].text, id);
+    return id;
+}
+
+void PolySession::release(int id) {
+    NameInfo &n = nameInfo[id];
+    if (--n.refs > 0)
+        return;
+    nameIds.erase(n.text);
+    n = NameInfo();
+    freeNames.push_back(id);
+}
+
+//---------------------------------------
+// PolySession
+//---------------------------------------
+PolySession::PolySession(string_view text, const ParserOptions &options) {
+    unitOptions.exactDegree = options.exactDegree;
+    root = newUnit(string());
+    labelUnits(root, 1);
+    parseUnit(root, UnitSection::START);
+    addToIndex(root);
+    edit(0, 0, text);
+}
+
+PolySession::~PolySession() {
+    destroy(root);
+}
+
+SessionUnit *PolySession::newUnit(string text) {
+    SessionUnit *u = new SessionUnit();
+    u->text = std::move(text);
+    u->newlines = count(u->text.begin(), u->text.end(), '\n');
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    u->priority = seed;
+    update(u);
+    return u;
+}
+
+string PolySession::text() const {
+    string s;
+    s.reserve(size());
+    for (SessionUnit *u = leftmost(root); u != nullptr; u = successor(u))
+        s += u->text;
+    return s;
+}
+
+size_t PolySession::size() const {
+    return root->bytes;
+}
+
+size_t PolySession::units() const {
+    return root->count;
+}
+
+// The unit holding the byte at offset and the offset it starts at; the
+// end of the text is in the last unit. Only the last unit can be empty.
+SessionUnit *PolySession::unitAt(size_t offset, size_t &start) const {
+    SessionUnit *u = root;
+    start = 0;
+    for (;;) {
+        size_t before = bytesOf(u->left);
+        if (offset < before) {
+            u = u->left;
+            continue;
+        }
+        offset -= before;
+        start += before;
+        if (offset < u->text.size() || u->right == nullptr)
+            return u;
+        offset -= u->text.size();
+        start += u->text.size();
+        u = u->right;
+    }
+}
+
+// The units holding the edited bytes are cut out and their new text is cut
+// again after every semicolon. An edit that erases the semicolon ending a
+// unit joins the unit with the next one first. The new units are lexed
+// and parsed in their section; after them, units are parsed again only
+// while their section differs from the one they were parsed in. Summaries
+// leave the indexes while their units are still in the tree, and enter
+// them once their units are in place.
+void PolySession::edit(size_t offset, size_t length, string_view replacement) {
+    if (offset > size() || length > size() - offset)
+        throw out_of_range("PolySession::edit: bytes outside the text");
+    size_t firstStart, lastStart;
+    SessionUnit *first = unitAt(offset, firstStart);
+    SessionUnit *last = first;
+    lastStart = firstStart;
+    if (length > 0)
+        last = unitAt(offset + length - 1, lastStart);
+    string merged = first->text.substr(0, offset - firstStart);
+    merged += replacement;
+    merged.append(last->text, offset + length - lastStart, string::npos);
+
+    size_t begin = indexOf(first), end = indexOf(last) + 1;
+    SessionUnit *prev = predecessor(first);
+    UnitSection section = prev == nullptr ? UnitSection::START : prev->endSection;
+    SessionUnit *next = successor(last);
+    for (SessionUnit *u = first; u != next; u = successor(u))
+        removeFromIndex(u);
+    for (; next != nullptr && !merged.empty() && merged.back() != ';'; end++) {
+        merged += next->text;
+        removeFromIndex(next);
+        next = successor(next);
+    }
+
+    SessionUnit *head, *old, *tail;
+    split(root, end, head, tail);
+    split(head, begin, head, old);
+    destroy(old);
+    vector<SessionUnit *> fresh;
+    size_t pos = 0;
+    for (size_t semi; (semi = merged.find(';', pos)) != string::npos; pos = semi + 1)
+        fresh.push_back(newUnit(merged.substr(pos, semi + 1 - pos)));
+    if (tail == nullptr)
+        fresh.push_back(newUnit(merged.substr(pos)));
+    for (SessionUnit *u : fresh) {
+        parseUnit(u, section);
+        section = u->endSection;
+        head = merge(head, u);
+    }
+    root = merge(head, tail);
+    root->parent = nullptr;
+    if (!fresh.empty())
+        labelUnits(fresh.front(), fresh.size());
+    for (SessionUnit *u : fresh)
+        addToIndex(u);
+
+    reparsed = fresh.size();
+    for (; next != nullptr && next->startSection != section; next = successor(next)) {
+        removeFromIndex(next);
+        parseUnit(next, section);
+        addToIndex(next);
+        section = next->endSection;
+        reparsed++;
+    }
+    settle();
+    built = 0;
+}
+
+// Lexes and parses the unit alone with Parser's productions. A unit that
+// does not parse still ends in the section its keywords put it in, so
+// that an error stays local to the unit. The names of a valid unit are
+// given session ids, which it holds until it leaves the indexes.
+void PolySession::parseUnit(SessionUnit *unit, UnitSection section) {
+    unit->startSection = section;
+    unit->parsed = ParsedUnit();
+    InputBuffer input(unit->text.data(), unit->text.size());
+    LexicalAnalyzer lexer(input);
+    unit->endSection = section == UnitSection::START ? UnitSection::POLY : section;
+    for (const Token &t : lexer.Tokens()) {
+        if (section == UnitSection::POLY && t.token_type == EXECUTE)
+            unit->endSection = UnitSection::EXEC;
+    }
+
+    Parser parser(lexer, unitOptions);
+    try {
+        parser.parseUnit(section, unit->parsed);
+        unit->valid = true;
+    } catch (const SyntaxError &) {
+        unit->valid = false;
+        return;
+    }
+    ParsedUnit &p = unit->parsed;
+    auto intern = [&](UnitName &n) { n.name = acquire(lexer.Names().name(n.name)); };
+    if (p.isDecl)
+        intern(p.decl);
+    if (p.isStmt) {
+        intern(p.var);
+        for (UnitName &c : p.calls)
+            intern(c);
+        for (UnitName &r : p.reads)
+            intern(r);
+    }
+}
+
+//---------------------------------------
+// Program-wide Checks
+//---------------------------------------
+// Every unit but the last ends with its semicolon, so the program parses
+// when every unit does: the last one then holds the INPUTS section. The
+// checks are those the parser makes while parsing, kept per name:
+//
+//  - Semantic Error 1: every declaration of a name but the first;
+//  - Semantic Error 3: every call of a name that is never declared;
+//  - Semantic Error 4: every call of a declared name whose argument
+//    count is not that of its first declaration;
+//  - Warning 1: every use of a variable up to its first assignment, an
+//    assignment's own arguments included;
+//  - Warning 2: every assignment none of whose live uses lie between it
+//    and the next assignment to the variable (that one's arguments
+//    included). OUTPUT uses are live; an argument is live when the
+//    assignment it is in is.
+
+void PolySession::addToIndex(SessionUnit *unit) {
+    if (!unit->valid) {
+        invalidUnits++;
+        return;
+    }
+    const ParsedUnit &p = unit->parsed;
+    if (p.isDecl) {
+        nameInfo[p.decl.name].decls.insert(Occ{unit, p.decl.line});
+        recheck(p.decl.name);
+        if (!p.badNameLines.empty()) {
+            badUnits.insert(unit);
+            errCount[1] += p.badNameLines.size();
+        }
+    }
+    if (!p.isStmt)
+        return;
+    for (const UnitName &c : p.calls) {
+        NameInfo &n = nameInfo[c.name];
+        n.calls[c.numArgs].insert(Occ{unit, c.line});
+        n.numCalls++;
+        recheck(c.name);
+    }
+    for (const UnitName &r : p.reads) {
+        nameInfo[r.name].uses.insert(Occ{unit, r.line});
+        recheck(r.name);
+    }
+    NameInfo &v = nameInfo[p.var.name];
+    Occ at{unit, p.var.line};
+    markWindow(p.var.name, unit);
+    if (p.stmtType == StmtType::OUTPUT_STMT) {
+        v.uses.insert(at);
+        v.liveUses.insert(at);
+    } else {
+        v.defs.insert(at);
+        unit->live = false;
+        deadDefs.insert(unit);
+        dirty.insert(at);
+    }
+    recheck(p.var.name);
+}
+
+void PolySession::removeFromIndex(SessionUnit *unit) {
+    if (!unit->valid) {
+        invalidUnits--;
+        return;
+    }
+    const ParsedUnit &p = unit->parsed;
+    if (p.isDecl) {
+        OccSet &decls = nameInfo[p.decl.name].decls;
+        decls.erase(decls.find(Occ{unit, p.decl.line}));
+        recheck(p.decl.name);
+        if (badUnits.erase(unit) > 0)
+            errCount[1] -= p.badNameLines.size();
+        release(p.decl.name);
+    }
+    if (!p.isStmt)
+        return;
+    NameInfo &v = nameInfo[p.var.name];
+    Occ at{unit, p.var.line};
+    if (p.stmtType == StmtType::OUTPUT_STMT) {
+        v.uses.erase(v.uses.find(at));
+        v.liveUses.erase(v.liveUses.find(at));
+    } else {
+        if (unit->live) {
+            for (const UnitName &r : p.reads) {
+                OccSet &live = nameInfo[r.name].liveUses;
+                live.erase(live.find(Occ{unit, r.line}));
+                markWindow(r.name, unit);
+            }
+        }
+        v.defs.erase(v.defs.find(at));
+        dirty.erase(at);
+        deadDefs.erase(unit);
+    }
+    markWindow(p.var.name, unit);
+    recheck(p.var.name);
+    for (const UnitName &c : p.calls) {
+        NameInfo &n = nameInfo[c.name];
+        auto it = n.calls.find(c.numArgs);
+        it->second.erase(it->second.find(Occ{unit, c.line}));
+        if (it->second.empty())
+            n.calls.erase(it);
+        n.numCalls--;
+        recheck(c.name);
+    }
+    for (const UnitName &r : p.reads) {
+        OccSet &uses = nameInfo[r.name].uses;
+        uses.erase(uses.find(Occ{unit, r.line}));
+        recheck(r.name);
+    }
+    release(p.var.name);
+    for (const UnitName &c : p.calls)
+        release(c.name);
+    for (const UnitName &r : p.reads)
+        release(r.name);
+}
+
+// Brings the error counts, the first declaration and the Warning 1 state
+// of a name up to date with its indexes.
+void PolySession::recheck(int id) {
+    NameInfo &n = nameInfo[id];
+    size_t errs[4] = {};
+    SessionUnit *firstDecl = nullptr;
+    if (n.decls.empty()) {
+        errs[2] = n.numCalls;
+    } else {
+        firstDecl = n.decls.begin()->unit;
+        errs[0] = n.decls.size() - 1;
+        auto it = n.calls.find(firstDecl->parsed.numParams);
+        errs[3] = n.numCalls - (it != n.calls.end() ? it->second.size() : 0);
+    }
+    for (int k : { 0, 2, 3 }) {
+        errCount[k] += errs[k] - n.errs[k];
+        n.errs[k] = errs[k];
+        if (errs[k] > 0)
+            errNames[k].insert(id);
+        else
+            errNames[k].erase(id);
+    }
+    if (firstDecl != n.firstDecl) {
+        if (n.firstDecl != nullptr)
+            polys.erase(Occ{n.firstDecl, n.firstDecl->parsed.decl.line});
+        if (firstDecl != nullptr)
+            polys.insert(Occ{firstDecl, firstDecl->parsed.decl.line});
+        n.firstDecl = firstDecl;
+    }
+    bool uninit = !n.uses.empty() &&
+        (n.defs.empty() || !unitBefore(n.defs.begin()->unit, n.uses.begin()->unit));
+    if (uninit)
+        uninitNames.insert(id);
+    else
+        uninitNames.erase(id);
+}
+
+// A change to the uses of a name in unit can only make a difference to
+// the assignment whose window holds them: the last one before the unit.
+void PolySession::markWindow(int id, SessionUnit *unit) {
+    OccSet &defs = nameInfo[id].defs;
+    auto it = defs.lower_bound(Occ{unit, INT_MIN});
+    if (it != defs.begin())
+        dirty.insert(*std::prev(it));
+}
+
+// Checks the marked assignments from the last one back. An assignment
+// that changes between useful and useless changes whether its arguments
+// are live, which marks assignments before it only, so each is checked
+// once.
+void PolySession::settle() {
+    while (!dirty.empty()) {
+        Occ d = *std::prev(dirty.end());
+        dirty.erase(std::prev(dirty.end()));
+        SessionUnit *unit = d.unit;
+        const NameInfo &v = nameInfo[unit->parsed.var.name];
+        auto nextDef = v.defs.upper_bound(d);
+        auto use = v.liveUses.upper_bound(Occ{unit, INT_MAX});
+        bool live = use != v.liveUses.end() &&
+            (nextDef == v.defs.end() || !unitBefore(nextDef->unit, use->unit));
+        if (live == unit->live)
+            continue;
+        unit->live = live;
+        if (live)
+            deadDefs.erase(unit);
+        else
+            deadDefs.insert(unit);
+        for (const UnitName &r : unit->parsed.reads) {
+            OccSet &uses = nameInfo[r.name].liveUses;
+            if (live)
+                uses.insert(Occ{unit, r.line});
+            else
+                uses.erase(uses.find(Occ{unit, r.line}));
+            markWindow(r.name, unit);
+        }
+    }
+}
+
+//---------------------------------------
+// Results
+//---------------------------------------
+PolyStatus PolySession::status() const {
+    if (invalidUnits > 0)
+        return PolyStatus::SYNTAX_ERROR;
+    for (size_t n : errCount) {
+        if (n > 0)
+            return PolyStatus::SEMANTIC_ERROR;
+    }
+    return PolyStatus::OK;
+}
+
+bool PolySession::hasTask(int n) const {
+    const vector<int> &tasks = leftmost(root)->parsed.tasks;
+    return find(tasks.begin(), tasks.end(), n) != tasks.end();
+}
+
+const vector<__int128> &PolySession::inputs() const {
+    return rightmost(root)->parsed.inputs;
+}
+
+static int lineOf(const SessionUnit *unit, int line) {
+    return (int)linesBefore(unit) + line;
+}
+
+// The lines of the first code with any, as the parser would sort them.
+const SemanticError &PolySession::semanticError() const {
+    if (built & 1)
+        return semError;
+    built |= 1;
+    semError = SemanticError();
+    if (status() != PolyStatus::SEMANTIC_ERROR)
+        return semError;
+    int code = 1;
+    while (errCount[code - 1] == 0)
+        code++;
+    vector<int> &lines = semError.lines;
+    if (code == 2) {
+        for (const SessionUnit *u : badUnits) {
+            for (int ln : u->parsed.badNameLines)
+                lines.push_back(lineOf(u, ln));
+        }
+    }
+    for (int id : errNames[code - 1]) {
+        const NameInfo &n = nameInfo[id];
+        if (code == 1) {
+            for (auto it = std::next(n.decls.begin()); it != n.decls.end(); ++it)
+                lines.push_back(lineOf(it->unit, it->line));
+            continue;
+        }
+        int arity = code == 4 ? n.firstDecl->parsed.numParams : -1;
+        for (const auto &calls : n.calls) {
+            if (calls.first == arity)
+                continue;
+            for (const Occ &c : calls.second)
+                lines.push_back(lineOf(c.unit, c.line));
+        }
+    }
+    semError.code = code;
+    sort(lines.begin(), lines.end());
+    return semError;
+}
+
+const vector<int> &PolySession::uninitializedWarnings() const {
+    if (built & 2)
+        return uninitWarnLines;
+    built |= 2;
+    uninitWarnLines.clear();
+    for (int id : uninitNames) {
+        const NameInfo &n = nameInfo[id];
+        for (const Occ &u : n.uses) {
+            if (!n.defs.empty() && unitBefore(n.defs.begin()->unit, u.unit))
+                break;
+            uninitWarnLines.push_back(lineOf(u.unit, u.line));
+        }
+    }
+    sort(uninitWarnLines.begin(), uninitWarnLines.end());
+    return uninitWarnLines;
+}
+
+const vector<int> &PolySession::uselessWarnings() const {
+    if (built & 4)
+        return uselessWarnLines;
+    built |= 4;
+    uselessWarnLines.clear();
+    if (hasTask(4)) {
+        for (const SessionUnit *u : deadDefs)
+            uselessWarnLines.push_back(lineOf(u, u->parsed.var.line));
+    }
+    sort(uselessWarnLines.begin(), uselessWarnLines.end());
+    return uselessWarnLines;
+}
+
+vector<PolyDegree> PolySession::degrees() const {
+    vector<PolyDegree> result;
+    result.reserve(polys.size());
+    for (const Occ &p : polys)
+        result.push_back({ nameInfo[p.unit->parsed.decl.name].text, p.unit->parsed.degree });
+    return result;
+}
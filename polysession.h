@@ -0,0 +1,135 @@
+#ifndef POLYSESSION_H
+#define POLYSESSION_H
+
+#include <cstddef>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "polyparser.h"
+
+///---------------------------------------------------------
+/// Incremental Analysis of Edited Programs
+///---------------------------------------------------------
+
+/// A piece of the program text ending with a semicolon (the last one ends
+/// with the text instead), with what lexing and parsing it gave.
+struct SessionUnit;
+
+enum class UnitSection;
+
+/// A program that is edited in place and kept checked: after every edit,
+/// status(), semanticError(), the warnings and the degrees are those a
+/// PolyProgram compiled from text() reports.
+///
+/// The text is kept as units, cut after every semicolon, so each unit
+/// holds at most one declaration or statement. The units are the nodes
+/// of a balanced tree that knows the bytes, lines and units under every
+/// node, so an edit finds and replaces the units it touches without
+/// moving the others. Each unit is lexed and parsed on its own by
+/// Parser::parseUnit and keeps the summary it gives: the names it
+/// declares, calls, assigns and reads, its degree and its lines relative
+/// to its first one. An edit parses only the units it touches (and the
+/// ones after them whose section changed, as when EXECUTE is typed or
+/// erased).
+///
+/// The program-wide checks are kept by name: every name of the text has
+/// its declarations, calls, assignments and uses in text order, and the
+/// counts of the semantic errors they make. An edit takes the summaries
+/// of the units it removes out of these indexes and puts those of the new
+/// units in, and only the names they mention are checked again. Whether
+/// an assignment is useless depends on the assignments after it, so a
+/// change there is followed backwards through the ones it affects, and no
+/// further. A name no unit mentions any more is dropped. The accessors
+/// build their lines from the indexes, in time for the lines they return.
+///
+/// Execution (Task 2) is not incremental: compile text() with PolyProgram
+/// to run the edited program.
+class PolySession {
+public:
+    /// Starts from the given text; only options.exactDegree is used.
+    explicit PolySession(std::string_view text, const ParserOptions &options = ParserOptions());
+    ~PolySession();
+
+    PolySession(const PolySession &) = delete;
+    PolySession &operator=(const PolySession &) = delete;
+
+    /// Replaces the length bytes at offset with replacement and brings the
+    /// results up to date. Throws std::out_of_range when the bytes are not
+    /// all inside the text.
+    void edit(size_t offset, size_t length, std::string_view replacement);
+
+    /// The current text, assembled from the units.
+    std::string text() const;
+    size_t size() const;
+
+    /// Units in the text and units lexed and parsed by the last edit (or
+    /// by the constructor).
+    size_t units() const;
+    size_t reparsedUnits() const { return reparsed; }
+
+    /// Results with the same meaning as in PolyProgram.
+    PolyStatus status() const;
+    const SemanticError &semanticError() const;
+    bool hasTask(int n) const;
+    const std::vector<__int128> &inputs() const;
+    const std::vector<int> &uninitializedWarnings() const;
+    const std::vector<int> &uselessWarnings() const;
+    std::vector<PolyDegree> degrees() const;
+
+private:
+    /// A place in the text: a unit and a line within it.
+    struct Occ {
+        SessionUnit *unit;
+        int line;
+    };
+    /// Orders places as they are in the text.
+    struct TextOrder {
+        bool operator()(const Occ &a, const Occ &b) const;
+    };
+    using OccSet = std::multiset<Occ, TextOrder>;
+
+    /// What the units say about one name.
+    struct NameInfo;
+
+    ParserOptions unitOptions;
+    SessionUnit *root = nullptr;
+    unsigned seed = 2463534242u;              // Of the tree priorities
+    size_t invalidUnits = 0;                  // Units that do not parse
+    size_t reparsed = 0;
+
+    // Names mentioned by the valid units, with a count of the mentions;
+    // ids of dropped names are given out again.
+    std::unordered_map<std::string, int> nameIds;
+    std::vector<NameInfo> nameInfo;
+    std::vector<int> freeNames;
+
+    size_t errCount[4] = {};                  // Lines of each Semantic Error code
+    std::unordered_set<int> errNames[4];      // Names with lines of codes 1, 3 and 4
+    std::unordered_set<SessionUnit *> badUnits;   // Declarations with lines of code 2
+    std::unordered_set<int> uninitNames;      // Names used before they are assigned
+    std::unordered_set<SessionUnit *> deadDefs;   // Useless assignments
+    OccSet polys;                             // First declarations
+    std::set<Occ, TextOrder> dirty;           // Assignments to check for usefulness
+
+    // The accessors' results, built when first asked for after an edit
+    mutable unsigned built = 0;
+    mutable SemanticError semError;
+    mutable std::vector<int> uninitWarnLines;
+    mutable std::vector<int> uselessWarnLines;
+
+    SessionUnit *newUnit(std::string text);
+    SessionUnit *unitAt(size_t offset, size_t &start) const;
+    void parseUnit(SessionUnit *unit, UnitSection section);
+    int acquire(std::string_view name);
+    void release(int id);
+    void addToIndex(SessionUnit *unit);
+    void removeFromIndex(SessionUnit *unit);
+    void recheck(int id);
+    void markWindow(int id, SessionUnit *unit);
+    void settle();
+};
+
+#endif
@@ -0,0 +1,139 @@
+#include "polyvm.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define POLYVM_X86 1
+#endif
+
+using namespace std;
+
+void PolyCode::emit(OpCode op, __int128 operand) {
+    code.push_back(Instr{op, operand});
+    if (op == OpCode::LOAD_PARAM || op == OpCode::LOAD_CONST)
+        depth++;
+    else if (op != OpCode::POW)
+        depth--;
+    if (depth > maxStack)
+        maxStack = depth;
+    if (op == OpCode::LOAD_PARAM && operand >= numParams)
+        numParams = (int)operand + 1;
+}
+
+int runPolyCode(const PolyCode &pc, const int *args) {
+    return runPolyCode(Wrap32(), pc, args);
+}
+
+void checkedOverflow() {
+    throw OverflowError();
+}
+
+//---------------------------------------
+// Batch Evaluation
+//---------------------------------------
+
+// Scalar fallback: gathers each point's arguments and runs the interpreter.
+static void batchScalar(const PolyCode &pc, const int *const *cols, int *out,
+                        size_t begin, size_t end) {
+    vector<int> args(pc.numParams > 0 ? pc.numParams : 1);
+    for (size_t k = begin; k < end; k++) {
+        for (int i = 0; i < pc.numParams; i++)
+            args[i] = cols[i][k];
+        out[k] = runPolyCode(pc, args.data());
+    }
+}
+
+#ifdef POLYVM_X86
+
+// One vector kernel per instruction set. V is the vector type and the
+// remaining parameters are its load, splat, add, sub, mul and store.
+#define BATCH_KERNEL(NAME, TARGET, V, LANES, VLOAD, VSET1, VADD, VSUB, VMUL, VSTORE)  \
+__attribute__((target(TARGET)))                                                       \
+static size_t NAME(const PolyCode &pc, const int *const *cols, int *out,              \
+                   size_t count) {                                                    \
+    V local[64];                                                                      \
+    V *heap = pc.maxStack > 64 ? new V[pc.maxStack] : nullptr;                        \
+    V *stack = heap != nullptr ? heap : local;                                        \
+    size_t k = 0;                                                                     \
+    for (; k + LANES <= count; k += LANES) {                                          \
+        int sp = 0;                                                                   \
+        for (const Instr &in : pc.code) {                                             \
+            switch (in.op) {                                                          \
+                case OpCode::LOAD_PARAM:                                              \
+                    stack[sp++] = VLOAD((const V *)(cols[(int)in.operand] + k));      \
+                    break;                                                            \
+                case OpCode::LOAD_CONST:                                              \
+                    stack[sp++] = VSET1(Wrap32().fromInt(in.operand));                \
+                    break;                                                            \
+                case OpCode::ADD:                                                     \
+                    sp--;                                                             \
+                    stack[sp-1] = VADD(stack[sp-1], stack[sp]);                       \
+                    break;                                                            \
+                case OpCode::SUB:                                                     \
+                    sp--;                                                             \
+                    stack[sp-1] = VSUB(stack[sp-1], stack[sp]);                       \
+                    break;                                                            \
+                case OpCode::MUL:                                                     \
+                    sp--;                                                             \
+                    stack[sp-1] = VMUL(stack[sp-1], stack[sp]);                       \
+                    break;                                                            \
+                case OpCode::POW: {                                                   \
+                    V base = stack[sp-1], res = VSET1(1);                             \
+                    for (int e = (int)in.operand; e > 0; e >>= 1) {                   \
+                        if (e & 1)                                                    \
+                            res = VMUL(res, base);                                    \
+                        base = VMUL(base, base);                                      \
+                    }                                                                 \
+                    stack[sp-1] = res;                                                \
+                    break;                                                            \
+                }                                                                     \
+            }                                                                         \
+        }                                                                             \
+        VSTORE((V *)(out + k), sp > 0 ? stack[sp-1] : VSET1(0));                      \
+    }                                                                                 \
+    delete[] heap;                                                                    \
+    return k;                                                                         \
+}
+
+BATCH_KERNEL(batchAVX2, "avx2", __m256i, 8, _mm256_loadu_si256, _mm256_set1_epi32,
+             _mm256_add_epi32, _mm256_sub_epi32, _mm256_mullo_epi32, _mm256_storeu_si256)
+
+BATCH_KERNEL(batchAVX512, "avx512f", __m512i, 16, _mm512_loadu_si512, _mm512_set1_epi32,
+             _mm512_add_epi32, _mm512_sub_epi32, _mm512_mullo_epi32, _mm512_storeu_si512)
+
+#endif
+
+bool batchKernelSupported(BatchKernel kernel) {
+    switch (kernel) {
+        case BatchKernel::AUTO:
+        case BatchKernel::SCALAR:
+            return true;
+#ifdef POLYVM_X86
+        case BatchKernel::AVX2:
+            return __builtin_cpu_supports("avx2");
+        case BatchKernel::AVX512:
+            return __builtin_cpu_supports("avx512f");
+#endif
+        default:
+            return false;
+    }
+}
+
+void runPolyCodeBatch(const PolyCode &pc, const int *const *cols, int *out,
+                      size_t count, BatchKernel kernel) {
+    if (kernel == BatchKernel::AUTO) {
+        if (batchKernelSupported(BatchKernel::AVX512))
+            kernel = BatchKernel::AVX512;
+        else if (batchKernelSupported(BatchKernel::AVX2))
+            kernel = BatchKernel::AVX2;
+        else
+            kernel = BatchKernel::SCALAR;
+    }
+    size_t done = 0;
+#ifdef POLYVM_X86
+    if (kernel == BatchKernel::AVX512 && batchKernelSupported(kernel))
+        done = batchAVX512(pc, cols, out, count);
+    else if (kernel == BatchKernel::AVX2 && batchKernelSupported(kernel))
+        done = batchAVX2(pc, cols, out, count);
+#endif
+    batchScalar(pc, cols, out, done, count);  // the tail that fills no vector
+}
@@ -0,0 +1,204 @@
+#ifndef POLYVM_H
+#define POLYVM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "numdomain.h"
+
+///---------------------------------------------------------
+/// Bytecode for Polynomial Bodies (Task 2)
+///---------------------------------------------------------
+
+/// Operations of the evaluation stack machine. Loads push one value; binary
+/// operations pop the right operand, then the left one, and push the
+/// result; POW replaces the top of the stack with its operand-th power.
+enum class OpCode : uint8_t { LOAD_PARAM, LOAD_CONST, ADD, SUB, MUL, POW };
+
+/// A single instruction; operand is a parameter index, a literal or an
+/// exponent depending on the opcode. Literals are kept as written and
+/// converted by the domain when they are loaded.
+struct Instr {
+    OpCode op;
+    __int128 operand;
+};
+
+/// A polynomial body lowered to straight-line bytecode. The result is the
+/// single value left on the stack.
+struct PolyCode {
+    std::vector<Instr> code;
+    int maxStack = 0;             // Deepest operand stack the code reaches
+    int numParams = 0;            // One more than the highest parameter loaded
+    int depth = 0;                // Stack depth after the last emitted instruction
+
+    void emit(OpCode op, __int128 operand = 0);
+};
+
+/// Runs the bytecode on the given arguments in the numeric domain dom.
+template <class D>
+typename D::Value runPolyCode(const D &dom, const PolyCode &pc, const typename D::Value *args) {
+    typedef typename D::Value Value;
+    Value local[64];
+    std::vector<Value> heap;
+    Value *stack = local;
+    if (pc.maxStack > 64) {
+        heap.resize(pc.maxStack);
+        stack = heap.data();
+    }
+    int sp = 0;
+    for (const Instr &in : pc.code) {
+        switch (in.op) {
+            case OpCode::LOAD_PARAM:
+                stack[sp++] = args[in.operand];
+                break;
+            case OpCode::LOAD_CONST:
+                stack[sp++] = dom.fromInt(in.operand);
+                break;
+            case OpCode::ADD:
+                sp--;
+                stack[sp-1] = dom.add(stack[sp-1], stack[sp]);
+                break;
+            case OpCode::SUB:
+                sp--;
+                stack[sp-1] = dom.sub(stack[sp-1], stack[sp]);
+                break;
+            case OpCode::MUL:
+                sp--;
+                stack[sp-1] = dom.mul(stack[sp-1], stack[sp]);
+                break;
+            case OpCode::POW:
+                stack[sp-1] = domainPow(dom, stack[sp-1], (int)in.operand);
+                break;
+        }
+    }
+    return sp > 0 ? stack[sp-1] : dom.fromInt(0);
+}
+
+/// Runs the bytecode on the given arguments with 32-bit wrapping arithmetic.
+int runPolyCode(const PolyCode &pc, const int *args);
+
+/// Runs the bytecode at count points at once in the numeric domain dom,
+/// dispatching each instruction once for all of them: parameter i of
+/// point k is cols[i][k] and its result goes to out[k]. The operand stack
+/// holds one row of count values per level. An OverflowError from any
+/// point ends the whole call.
+template <class D>
+void runPolyCodeLanes(const D &dom, const PolyCode &pc, const typename D::Value *const *cols,
+                      typename D::Value *out, size_t count) {
+    typedef typename D::Value Value;
+    Value local[256];
+    std::vector<Value> heap;
+    Value *stack = local;
+    if ((size_t)pc.maxStack * count > 256) {
+        heap.resize((size_t)pc.maxStack * count);
+        stack = heap.data();
+    }
+    size_t sp = 0;                                 // Rows on the stack
+    for (const Instr &in : pc.code) {
+        Value *top = stack + (sp > 0 ? sp - 1 : 0) * count;
+        switch (in.op) {
+            case OpCode::LOAD_PARAM:
+                top = stack + sp++ * count;
+                for (size_t k = 0; k < count; k++)
+                    top[k] = cols[in.operand][k];
+                break;
+            case OpCode::LOAD_CONST: {
+                Value v = dom.fromInt(in.operand);
+                top = stack + sp++ * count;
+                for (size_t k = 0; k < count; k++)
+                    top[k] = v;
+                break;
+            }
+            case OpCode::ADD:
+                top -= count;
+                for (size_t k = 0; k < count; k++)
+                    top[k] = dom.add(top[k], top[count + k]);
+                sp--;
+                break;
+            case OpCode::SUB:
+                top -= count;
+                for (size_t k = 0; k < count; k++)
+                    top[k] = dom.sub(top[k], top[count + k]);
+                sp--;
+                break;
+            case OpCode::MUL:
+                top -= count;
+                for (size_t k = 0; k < count; k++)
+                    top[k] = dom.mul(top[k], top[count + k]);
+                sp--;
+                break;
+            case OpCode::POW:
+                for (size_t k = 0; k < count; k++)
+                    top[k] = domainPow(dom, top[k], (int)in.operand);
+                break;
+        }
+    }
+    for (size_t k = 0; k < count; k++)
+        out[k] = sp > 0 ? stack[(sp - 1) * count + k] : dom.fromInt(0);
+}
+
+/// Appends an instruction to pc, folding it when its operands are
+/// constants in dom: LOAD_CONST a, LOAD_CONST b, MUL becomes one
+/// LOAD_CONST, and adding or subtracting 0, multiplying by 1 and POW 1 are
+/// dropped. A fold is skipped when the domain raises OverflowError, which
+/// includes a literal that does not fit.
+template <class D>
+void emitFolded(const D &dom, PolyCode &pc, OpCode op, __int128 operand = 0) {
+    std::vector<Instr> &code = pc.code;
+    size_t n = code.size();
+    bool topConst = n >= 1 && code[n-1].op == OpCode::LOAD_CONST;
+    bool pairConst = topConst && n >= 2 && code[n-2].op == OpCode::LOAD_CONST;
+    try {
+        switch (op) {
+            case OpCode::LOAD_PARAM:
+            case OpCode::LOAD_CONST:
+                break;
+            case OpCode::POW:
+                if (operand == 1)
+                    return;
+                if (topConst) {
+                    code[n-1].operand = (__int128)domainPow(dom, dom.fromInt(code[n-1].operand),
+                                                            (int)operand);
+                    return;
+                }
+                break;
+            case OpCode::ADD:
+            case OpCode::SUB:
+            case OpCode::MUL:
+                if (pairConst) {
+                    typename D::Value a = dom.fromInt(code[n-2].operand);
+                    typename D::Value b = dom.fromInt(code[n-1].operand);
+                    typename D::Value v = op == OpCode::ADD ? dom.add(a, b)
+                                        : op == OpCode::SUB ? dom.sub(a, b) : dom.mul(a, b);
+                    code.pop_back();
+                    code.back().operand = (__int128)v;
+                    pc.depth--;
+                    return;
+                }
+                if (topConst && dom.fromInt(code[n-1].operand) ==
+                                dom.fromInt(op == OpCode::MUL ? 1 : 0)) {
+                    code.pop_back();
+                    pc.depth--;
+                    return;
+                }
+                break;
+        }
+    } catch (const OverflowError &) {
+    }
+    pc.emit(op, operand);
+}
+
+/// Vector width used by runPolyCodeBatch; AUTO picks the widest one the CPU
+/// supports (16 lanes with AVX-512, 8 with AVX2, else scalar).
+enum class BatchKernel { AUTO, SCALAR, AVX2, AVX512 };
+
+bool batchKernelSupported(BatchKernel kernel);
+
+/// Evaluates the bytecode at count points given as structure-of-arrays
+/// columns: parameter i of point k is cols[i][k]. Writes one value per
+/// point to out, bit-for-bit equal to runPolyCode on that point. Each
+/// instruction is dispatched once per 8 or 16 points.
+void runPolyCodeBatch(const PolyCode &pc, const int *const *cols, int *out,
+                      size_t count, BatchKernel kernel = BatchKernel::AUTO);
+
+#endif
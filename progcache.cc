@@ -0,0 +1,154 @@
+#include "progcache.h"
+#include "parser.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Bump whenever the layout of an entry or of Parser::saveCompiled changes.
+static const uint32_t CACHE_VERSION = 3;
+static const char CACHE_MAGIC[4] = { 'P', 'C', 'C', 'P' };
+
+/// Start of every entry.
+struct CacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t keyLo;
+    uint64_t keyHi;
+    uint32_t instrSize;       // sizeof(Instr)
+    uint32_t planInstrSize;   // sizeof(PlanInstr)
+    uint64_t sumLo;           // Hash of the payload
+    uint64_t sumHi;
+};
+
+//---------------------------------------
+// Keys
+//---------------------------------------
+// Two independent 64-bit lanes over 8-byte words of the input.
+static void hashBytes(uint64_t &a, uint64_t &b, const char *data, size_t len) {
+    const uint64_t M1 = 0x9e3779b97f4a7c15ULL, M2 = 0xc2b2ae3d27d4eb4fULL;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, data + i, 8);
+        a = (a ^ w) * M1;
+        a ^= a >> 29;
+        b = (b + w) * M2;
+        b ^= b >> 31;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, data + i, len - i);
+    a = ((a ^ tail) * M1) ^ len;
+    b = ((b + tail) * M2) ^ (len << 1);
+    a ^= a >> 32;
+    b ^= b >> 29;
+}
+
+CacheKey cacheKey(const char *data, size_t len, const ParserOptions &options) {
+    CacheKey key;
+    key.lo = 0x243f6a8885a308d3ULL;
+    key.hi = 0x13198a2e03707344ULL;
+    hashBytes(key.lo, key.hi, data, len);
+    // The options that change the compiled program
+    uint64_t opts[] = {
+        (uint64_t)options.hornerEval, (uint64_t)options.exactDegree,
+        (uint64_t)options.domain, options.modulus, (uint64_t)options.cse,
+        (uint64_t)options.fold, (uint64_t)options.dce,
+    };
+    hashBytes(key.lo, key.hi, (const char *)opts, sizeof(opts));
+    return key;
+}
+
+// Checksum of an entry's payload, so that a damaged entry is a miss.
+static void payloadSum(const char *data, size_t len, uint64_t &lo, uint64_t &hi) {
+    lo = 0xa4093822299f31d0ULL;
+    hi = 0x082efa98ec4e6c89ULL;
+    hashBytes(lo, hi, data, len);
+}
+
+string CacheKey::hex() const {
+    char buf[33];
+    snprintf(buf, sizeof(buf), "%016llx%016llx", (unsigned long long)hi, (unsigned long long)lo);
+    return buf;
+}
+
+//---------------------------------------
+// ProgramCache
+//---------------------------------------
+string ProgramCache::path(const CacheKey &key) const {
+    return dir + "/" + key.hex() + ".pcc";
+}
+
+void ProgramCache::unmap() {
+    if (map != nullptr)
+        munmap(map, mapLen);
+    map = nullptr;
+    mapLen = 0;
+}
+
+ProgramCache::~ProgramCache() {
+    unmap();
+}
+
+bool ProgramCache::lookup(const CacheKey &key, const char *&blob, size_t &len) {
+    unmap();
+    int fd = open(path(key).c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CacheHeader)) {
+        close(fd);
+        return false;
+    }
+    void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        return false;
+    map = addr;
+    mapLen = st.st_size;
+    CacheHeader h;
+    memcpy(&h, map, sizeof(h));
+    blob = (const char *)map + sizeof(h);
+    len = mapLen - sizeof(h);
+    uint64_t sumLo, sumHi;
+    if (memcmp(h.magic, CACHE_MAGIC, 4) != 0 || h.version != CACHE_VERSION ||
+        h.keyLo != key.lo || h.keyHi != key.hi || h.instrSize != sizeof(Instr) ||
+        h.planInstrSize != sizeof(PlanInstr)) {
+        unmap();
+        return false;
+    }
+    payloadSum(blob, len, sumLo, sumHi);
+    if (sumLo != h.sumLo || sumHi != h.sumHi) {
+        unmap();
+        return false;
+    }
+    return true;
+}
+
+void ProgramCache::store(const CacheKey &key, const string &payload) {
+    if (mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST)
+        return;
+    CacheHeader h;
+    memcpy(h.magic, CACHE_MAGIC, 4);
+    h.version = CACHE_VERSION;
+    h.keyLo = key.lo;
+    h.keyHi = key.hi;
+    h.instrSize = sizeof(Instr);
+    h.planInstrSize = sizeof(PlanInstr);
+    payloadSum(payload.data(), payload.size(), h.sumLo, h.sumHi);
+    string final = path(key);
+    string tmp = final + "." + to_string(getpid()) + "." + to_string((uintptr_t)this) + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if (f == nullptr)
+        return;
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+              fwrite(payload.data(), 1, payload.size(), f) == payload.size();
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp.c_str(), final.c_str()) != 0)
+        remove(tmp.c_str());
+}
@@ -0,0 +1,113 @@
+#ifndef PROGCACHE_H
+#define PROGCACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include "polyparser.h"
+
+///---------------------------------------------------------
+/// Compiled Program Cache
+///---------------------------------------------------------
+
+/// Identifies a compiled program: a 128-bit hash of the source text and
+/// of the options that change what compiling it produces.
+struct CacheKey {
+    uint64_t lo = 0;
+    uint64_t hi = 0;
+
+    std::string hex() const;
+    bool operator==(const CacheKey &o) const { return lo == o.lo && hi == o.hi; }
+};
+
+CacheKey cacheKey(const char *data, size_t len, const ParserOptions &options);
+
+/// Appends values to a byte string in native layout. Vectors are stored
+/// as a 64-bit count followed by their elements, which must be trivially
+/// copyable.
+struct BlobWriter {
+    std::string data;
+
+    template <class T> void pod(const T &v) {
+        static_assert(std::is_trivially_copyable<T>::value, "pod");
+        data.append((const char *)&v, sizeof(T));
+    }
+    template <class T> void vec(const std::vector<T> &v) {
+        static_assert(std::is_trivially_copyable<T>::value, "vec");
+        pod((uint64_t)v.size());
+        data.append((const char *)v.data(), v.size() * sizeof(T));
+    }
+    void str(std::string_view s) {
+        pod((uint64_t)s.size());
+        data.append(s.data(), s.size());
+    }
+};
+
+/// Reads back what a BlobWriter wrote. A read past the end fails and
+/// leaves ok false; every later read fails too.
+struct BlobReader {
+    const char *p;
+    const char *end;
+    bool ok = true;
+
+    BlobReader(const char *data, size_t len) : p(data), end(data + len) {}
+
+    template <class T> bool pod(T &v) {
+        if (!ok || (size_t)(end - p) < sizeof(T))
+            return ok = false;
+        memcpy(&v, p, sizeof(T));
+        p += sizeof(T);
+        return true;
+    }
+    template <class T> bool vec(std::vector<T> &v) {
+        uint64_t n;
+        if (!pod(n) || n > (uint64_t)(end - p) / sizeof(T))
+            return ok = false;
+        v.resize(n);
+        memcpy((void *)v.data(), p, n * sizeof(T));
+        p += n * sizeof(T);
+        return true;
+    }
+    bool str(std::string &s) {
+        uint64_t n;
+        if (!pod(n) || n > (uint64_t)(end - p))
+            return ok = false;
+        s.assign(p, n);
+        p += n;
+        return true;
+    }
+};
+
+/// A directory of compiled programs, one file per key. An entry starts
+/// with a header naming the format version, the key, the sizes of the
+/// records stored raw and a checksum of the payload, so an entry written
+/// by another build of the format, or damaged since, is ignored. Entries
+/// are read through a read-only mapping and written to a temporary file
+/// that is renamed into place, so concurrent runs never see a partial
+/// entry. Every failure just means a cache miss.
+class ProgramCache {
+public:
+    explicit ProgramCache(const std::string &dir) : dir(dir) {}
+
+    /// Maps the entry of key; on success blob is its payload, valid until
+    /// the next lookup or the cache is destroyed.
+    bool lookup(const CacheKey &key, const char *&blob, size_t &len);
+    /// Stores payload as the entry of key.
+    void store(const CacheKey &key, const std::string &payload);
+
+    ~ProgramCache();
+
+private:
+    std::string dir;
+    void *map = nullptr;
+    size_t mapLen = 0;
+
+    std::string path(const CacheKey &key) const;
+    void unmap();
+};
+
+#endif
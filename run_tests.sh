@@ -12,7 +12,7 @@ NC='\033[0m' # No Color
 
 # Compile the program
 echo -e "${YELLOW}Compiling...${NC}"
-g++ -std=c++17 -Wall -o poly_parser inputbuf.cc lexer.cc parser.cc
+g++ -std=c++17 -Wall -pthread -o poly_parser inputbuf.cc intern.cc lexer.cc threadpool.cc polyvm.cc sparsepoly.cc polyjit.cc parser.cc polyparser.cc polysession.cc progcache.cc outsink.cc main.cc
 if [ $? -ne 0 ]; then
     echo -e "${RED}Compilation failed!${NC}"
     exit 1
@@ -30,12 +30,13 @@ run_test() {
     local test_name="$1"
     local input_file="$2"
     local expected_output="$3"
+    local flags="$4"
     
     ((TESTS_TOTAL++))
     
     echo -n "Testing $test_name... "
     
-    actual_output=$(./poly_parser < "$input_file" 2>&1)
+    actual_output=$(./poly_parser $flags < "$input_file" 2>&1)
     
     if [ "$actual_output" == "$expected_output" ]; then
         echo -e "${GREEN}PASSED${NC}"
@@ -70,6 +71,88 @@ run_syntax_error_test() {
     fi
 }
 
+# Function to run test on binary output, compared as hex bytes
+run_binary_test() {
+    local test_name="$1"
+    local input_file="$2"
+    local expected_output="$3"
+    local flags="$4"
+
+    ((TESTS_TOTAL++))
+
+    echo -n "Testing $test_name... "
+
+    actual_output=$(./poly_parser $flags < "$input_file" 2>&1 | od -An -tx1 | tr -s ' \n' ' ' | sed 's/^ //; s/ $//')
+
+    if [ "$actual_output" == "$expected_output" ]; then
+        echo -e "${GREEN}PASSED${NC}"
+        ((TESTS_PASSED++))
+    else
+        echo -e "${RED}FAILED${NC}"
+        echo "  Expected: $expected_output"
+        echo "  Actual:   $actual_output"
+        ((TESTS_FAILED++))
+    fi
+}
+
+# Function to check that a mode gives the default output on every test file
+run_differential_tests() {
+    local mode_name="$1"
+    local flags="$2"
+    local input_file
+
+    for input_file in tests/*.txt; do
+        ((TESTS_TOTAL++))
+
+        echo -n "Testing $mode_name on $(basename "$input_file")... "
+
+        expected_output=$(./poly_parser < "$input_file" 2>&1)
+        actual_output=$(./poly_parser $flags < "$input_file" 2>&1)
+
+        if [ "$actual_output" == "$expected_output" ]; then
+            echo -e "${GREEN}PASSED${NC}"
+            ((TESTS_PASSED++))
+        else
+            echo -e "${RED}FAILED${NC}"
+            echo "  Expected: $expected_output"
+            echo "  Actual:   $actual_output"
+            ((TESTS_FAILED++))
+        fi
+    done
+}
+
+# Function to check that reading the program another way gives the output
+# of reading it from stdin, on every test file
+run_input_differential_tests() {
+    local mode_name="$1"
+    local source="$2"
+    local flags="$3"
+    local input_file
+
+    for input_file in tests/*.txt; do
+        ((TESTS_TOTAL++))
+
+        echo -n "Testing $mode_name on $(basename "$input_file")... "
+
+        expected_output=$(./poly_parser < "$input_file" 2>&1)
+        if [ "$source" == "path" ]; then
+            actual_output=$(./poly_parser $flags "$input_file" < /dev/null 2>&1)
+        else
+            actual_output=$(cat "$input_file" | ./poly_parser $flags 2>&1)
+        fi
+
+        if [ "$actual_output" == "$expected_output" ]; then
+            echo -e "${GREEN}PASSED${NC}"
+            ((TESTS_PASSED++))
+        else
+            echo -e "${RED}FAILED${NC}"
+            echo "  Expected: $expected_output"
+            echo "  Actual:   $actual_output"
+            ((TESTS_FAILED++))
+        fi
+    done
+}
+
 echo "========================================"
 echo "Running Polynomial Parser Tests"
 echo "========================================"
@@ -84,12 +167,20 @@ run_test "Numeric arguments add(3,5), mult(4,6)" "tests/test_numeric_args.txt" "
 24"
 run_test "Constant polynomial (42)" "tests/test_constant_poly.txt" "42
 constant: 0"
+run_test "Nesting 10000 deep" "tests/test_deep_nesting.txt" "10003
+100060009
+f: 1
+g: 2"
+run_test "Repeated parameter name uses the first" "tests/test_repeated_param.txt" "10"
+run_test "More than 2000 variables" "tests/test_many_vars.txt" "284
+62"
 echo ""
 
 # Semantic Error Tests
 echo "--- Semantic Errors ---"
 run_test "Error 1: Duplicate polynomial name" "tests/test_sem_err1_duplicate.txt" "Semantic Error Code 1: 5"
 run_test "Error 2: Undefined var in poly body" "tests/test_sem_err2_invalid_name.txt" "Semantic Error Code 2: 3"
+run_test "Error 2: Parameters of earlier declarations" "tests/test_param_scope.txt" "Semantic Error Code 2: 4 5"
 run_test "Error 3: Undeclared polynomial call" "tests/test_sem_err3_undeclared.txt" "Semantic Error Code 3: 6"
 run_test "Error 4: Wrong argument count" "tests/test_sem_err4_wrong_args.txt" "Semantic Error Code 4: 6"
 echo ""
@@ -123,6 +214,316 @@ h: 0
 linear: 1"
 run_test "High degree polynomials" "tests/test_high_degree.txt" "high: 10
 product: 12"
+run_test "Degrees as written" "tests/test_exact_degree.txt" "-1
+36
+218
+f: 2
+g: 2
+h: 3"
+run_test "Degrees after cancellation" "tests/test_exact_degree.txt" "-1
+36
+218
+f: 0
+g: 2
+h: 2" "--exact-degree"
+run_test "Exact coefficients, 128-bit overflow" "tests/test_exact_overflow.txt" "f: 1
+g: 200
+h: 3" "--exact-degree"
+run_test "Evaluation without Horner form" "tests/test_exact_degree.txt" "-1
+36
+218
+f: 2
+g: 2
+h: 3" "--no-horner"
+
+echo ""
+
+# Numeric Domains - the same program evaluated in each arithmetic
+echo "--- Numeric Domains ---"
+run_test "32-bit wrapping (default)" "tests/test_domains.txt" "-2067590183
+150729369
+1851998085
+689956897"
+run_test "64-bit wrapping" "tests/test_domains.txt" "-615385536168520743
+150729369
+1141262663115030405
+-6289078614652622815" "--domain=int64"
+run_test "128-bit (exact here)" "tests/test_domains.txt" "792594609633342198745
+150729369
+47741314925423434612613
+12157665459056928801" "--domain=int128"
+run_test "Checked 64-bit overflow" "tests/test_domains.txt" "Overflow Error: value does not fit in 64 bits" "--domain=checked"
+run_test "Modulo 10^9+7" "tests/test_domains.txt" "179970150
+150729369
+232473975
+953271190" "--domain=mod:1000000007"
+run_test "Wide literals, 32-bit" "tests/test_wide_literals.txt" "-494665727
+0"
+run_test "Wide literals, 64-bit" "tests/test_wide_literals.txt" "9000000000000000001
+7452894433344749568" "--domain=int64"
+run_test "Wide literals, checked" "tests/test_wide_literals.txt" "9000000000000000001
+Overflow Error: value does not fit in 64 bits" "--domain=checked"
+run_test "Wide literals, 128-bit" "tests/test_wide_literals.txt" "9000000000000000001
+32212254720000000000000000000" "--domain=int128"
+run_test "Wide literals, modulo 10^9+7" "tests/test_wide_literals.txt" "442
+400470234" "--domain=mod:1000000007"
+run_test "Literal beyond 64 bits, 64-bit" "tests/test_wide_literal_overflow.txt" "3
+0" "--domain=int64"
+run_test "Literal beyond 64 bits, checked" "tests/test_wide_literal_overflow.txt" "3
+Overflow Error: value does not fit in 64 bits" "--domain=checked"
+run_test "Literal beyond 64 bits, 128-bit" "tests/test_wide_literal_overflow.txt" "3
+18446744073709551616" "--domain=int128"
+echo ""
+
+# Common subexpressions - identical calls on the same values evaluated once
+echo "--- Common Subexpressions ---"
+run_test "Shared calls across reassignment and INPUT" "tests/test_cse.txt" "25
+25
+676
+100
+cse: 13 calls, 7 shared" "--stats --no-fold --no-dce"
+run_test "Same program without sharing" "tests/test_cse.txt" "25
+25
+676
+100
+cse: 13 calls, 0 shared" "--stats --no-cse --no-fold --no-dce"
+run_differential_tests "No CSE" "--no-cse"
+echo ""
+
+# Constant folding - calls that do not depend on INPUT computed up front
+echo "--- Constant Folding ---"
+run_test "Folded and specialized calls" "tests/test_fold.txt" "395
+3056
+3056
+84854
+199453
+0
+cse: 8 calls, 1 shared
+dce: 0 statements, 0 calls eliminated
+fold: 5 folded, 2 specialized" "--stats"
+run_test "Folding in the checked domain" "tests/test_fold.txt" "395
+3056
+3056
+84854
+199453
+0" "--domain=checked"
+run_differential_tests "No folding" "--no-fold"
+echo ""
+
+# Dead statements - useless assignments left out of execution
+echo "--- Dead Statement Elimination ---"
+run_test "Useless assignments eliminated" "tests/test_dce.txt" "10
+4
+cse: 1 calls, 0 shared
+dce: 4 statements, 6 calls eliminated
+fold: 0 folded, 0 specialized
+Warning Code 2: 8 9 10 11 14" "--stats"
+run_test "Checked domain keeps every call" "tests/test_dce.txt" "10
+4
+cse: 7 calls, 3 shared
+fold: 0 folded, 0 specialized
+Warning Code 2: 8 9 10 11 14" "--stats --domain=checked"
+run_differential_tests "No DCE" "--no-dce"
+echo ""
+
+# Memoization - repeated evaluations answered from the cache
+echo "--- Memo Cache ---"
+run_test "Repeated calls with stats" "tests/test_memo.txt" "9
+49
+625
+49
+cse: 8 calls, 0 shared
+memo: 3 hits, 5 misses, 0 evictions" "--memo=16 --stats --no-cse --no-fold --no-dce"
+run_test "Evictions at capacity 2" "tests/test_memo.txt" "9
+49
+625
+49
+cse: 8 calls, 0 shared
+memo: 3 hits, 5 misses, 3 evictions" "--memo=2 --stats --no-cse --no-fold --no-dce"
+run_differential_tests "Memo capacity 1" "--memo=1"
+run_differential_tests "Memo capacity 4096" "--memo=4096"
+echo ""
+
+# Input Modes - the program mapped, block read or named on the command line
+echo "--- Input Modes ---"
+run_differential_tests "Mapped stdin" "--input-mode=mmap"
+run_differential_tests "Block-read stdin" "--input-mode=block"
+run_input_differential_tests "Block-read pipe" "pipe" "--input-mode=block"
+run_input_differential_tests "Streamed pipe" "pipe" ""
+run_input_differential_tests "File path argument" "path" ""
+run_input_differential_tests "Block-read file path" "path" "--input-mode=block"
+run_test "Streamed path rejected" "tests/test_basic_task2.txt" "$(./poly_parser --help 2>&1)" "--input-mode=stream tests/test_basic_task2.txt"
+run_test "Unreadable path" "tests/test_basic_task2.txt" "InputBuffer: cannot read tests: Is a directory" "tests"
+echo ""
+
+# Lexer Modes - same results with on-demand tokenization
+echo "--- Lexer Modes ---"
+run_test "Streaming tokens, nested evaluation" "tests/test_nested_eval.txt" "49" "--stream-tokens"
+run_test "Streaming tokens over cin" "tests/test_multiple_tasks.txt" "5
+Warning Code 2: 8
+f: 2
+g: 1" "--stream-tokens --input-mode=stream"
+run_differential_tests "Streaming tokens over cin" "--stream-tokens --input-mode=stream"
+run_test "Scalar scanner, parenthesized bodies" "tests/test_parenthesized.txt" "24
+35
+f: 2
+g: 2" "--scanner=scalar"
+run_test "SSE2 scanner, multi-variable body" "tests/test_complex_poly.txt" "82
+complex: 4" "--scanner=sse2"
+
+echo ""
+
+# Parallel POLY parsing - declarations parsed in chunks on a thread pool
+echo "--- Parallel POLY Parsing ---"
+run_test "Duplicates in different chunks" "tests/test_parallel_poly.txt" "Semantic Error Code 1: 30 41" "--parallel-poly=4"
+run_test "Deep nesting in chunks" "tests/test_deep_nesting.txt" "10003
+100060009
+f: 1
+g: 2" "--parallel-poly=2"
+run_differential_tests "Parallel POLY parsing" "--parallel-poly=3"
+
+echo ""
+
+# Parallel execution - independent calls run on a work-stealing pool
+echo "--- Parallel Execution ---"
+run_test "Outputs in program order" "tests/test_parallel_exec.txt" "25
+9
+9
+625" "--parallel-exec=3"
+run_test "Overflow after earlier outputs" "tests/test_parallel_exec.txt" "25
+Overflow Error: value does not fit in 64 bits" "--parallel-exec=3 --domain=checked"
+run_differential_tests "Parallel execution" "--parallel-exec=3"
+
+echo ""
+
+# Lane execution - the plan run over lanes of input sets
+echo "--- Lane Execution ---"
+run_test "128-bit lanes" "tests/test_domains.txt" "792594609633342198745
+150729369
+47741314925423434612613
+12157665459056928801" "--lane-exec --domain=int128"
+run_test "Checked overflow in a lane" "tests/test_parallel_exec.txt" "25
+Overflow Error: value does not fit in 64 bits" "--lane-exec --domain=checked"
+run_differential_tests "Lane execution" "--lane-exec"
+
+echo ""
+
+# Run-many mode - one run per line of an inputs file, sharded on a pool
+echo "--- Inputs File ---"
+run_test "Results in file order" "tests/test_inputs_file.txt" "-1013 0
+-1 3
+6 0
+INPUTS ERROR
+249525446 1
+-1602242753 9
+INPUTS ERROR" "--inputs-file=tests/test_inputs_file.in --inputs-threads=2"
+run_test "Tagged results, checked overflow" "tests/test_inputs_file.txt" "1: -1013 0
+2: -1 3
+3: 6 0
+4: INPUTS ERROR
+5: Overflow Error: value does not fit in 64 bits
+6: Overflow Error: value does not fit in 64 bits
+7: INPUTS ERROR" "--inputs-file=tests/test_inputs_file.in --inputs-tagged --inputs-threads=1 --domain=checked"
+run_test "Large values as in the program's INPUTS" "tests/test_inputs_saturate.txt" "-1602242753
+9"
+
+echo ""
+
+# Output formats - buffered text and little-endian binary
+echo "--- Output Formats ---"
+run_binary_test "Binary 32-bit outputs" "tests/test_binary_output.txt" "00 11 10 24 70 11 01 00" "--output-format=binary"
+run_binary_test "Binary 128-bit outputs" "tests/test_binary_output.txt" "00 11 10 24 01 00 00 00 00 00 00 00 00 00 00 00 70 11 01 00 00 00 00 00 00 00 00 00 00 00 00 00" "--output-format=binary --domain=int128"
+run_binary_test "Binary records of an inputs file" "tests/test_inputs_file.txt" "02 00 00 00 0b fc ff ff 00 00 00 00 02 00 00 00 ff ff ff ff 03 00 00 00 02 00 00 00 06 00 00 00 00 00 00 00 ff ff ff ff 02 00 00 00 c6 74 df 0e 01 00 00 00 02 00 00 00 3f b7 7f a0 09 00 00 00 ff ff ff ff" "--output-format=binary --inputs-file=tests/test_inputs_file.in --inputs-threads=2"
+run_differential_tests "Text output format" "--output-format=text"
+((TESTS_TOTAL++))
+echo -n "Testing Write error exits nonzero... "
+actual_output=$(./poly_parser < tests/test_basic_task2.txt 2>&1 > /dev/full)
+status=$?
+if [ "$status" -eq 255 ] && [ "$actual_output" == "OutputSink: cannot write: No space left on device" ]; then
+    echo -e "${GREEN}PASSED${NC}"
+    ((TESTS_PASSED++))
+else
+    echo -e "${RED}FAILED${NC}"
+    echo "  Status: $status"
+    echo "  Actual: $actual_output"
+    ((TESTS_FAILED++))
+fi
+
+echo ""
+
+# Compiled program cache - the second run of a program skips the parser
+echo "--- Compiled Program Cache ---"
+CACHE_DIR=$(mktemp -d)
+run_test "First run compiles" "tests/test_basic_task2.txt" "cache: miss
+13
+cse: 1 calls, 0 shared
+dce: 0 statements, 0 calls eliminated
+fold: 0 folded, 0 specialized" "--cache-dir=$CACHE_DIR --stats"
+run_test "Second run loads" "tests/test_basic_task2.txt" "cache: hit
+13
+cse: 1 calls, 0 shared
+dce: 0 statements, 0 calls eliminated
+fold: 0 folded, 0 specialized" "--cache-dir=$CACHE_DIR --stats"
+run_test "Other options compile again" "tests/test_basic_task2.txt" "cache: miss
+13
+cse: 1 calls, 0 shared
+dce: 0 statements, 0 calls eliminated" "--cache-dir=$CACHE_DIR --stats --no-fold"
+run_differential_tests "Cache fill" "--cache-dir=$CACHE_DIR"
+run_differential_tests "Cache hit" "--cache-dir=$CACHE_DIR"
+rm -rf "$CACHE_DIR"
+CACHE_DIR=$(mktemp -d)
+./poly_parser --cache-dir="$CACHE_DIR" < tests/test_complex_poly.txt > /dev/null 2>&1
+for entry in "$CACHE_DIR"/*.pcc; do
+    printf '\377' | dd of="$entry" bs=1 seek=195 conv=notrunc 2> /dev/null
+done
+run_test "Damaged entry compiles again" "tests/test_complex_poly.txt" "cache: miss
+82
+cse: 1 calls, 0 shared
+dce: 0 statements, 0 calls eliminated
+fold: 0 folded, 0 specialized
+complex: 4" "--cache-dir=$CACHE_DIR --stats"
+run_test "Replaced entry loads" "tests/test_complex_poly.txt" "cache: hit
+82
+cse: 1 calls, 0 shared
+dce: 0 statements, 0 calls eliminated
+fold: 0 folded, 0 specialized
+complex: 4" "--cache-dir=$CACHE_DIR --stats"
+rm -rf "$CACHE_DIR"
+
+echo ""
+
+# Incremental edits - an edit script applied through an edit session
+echo "--- Incremental Edits ---"
+run_test "Edits to calls and outputs" "tests/test_multiple_tasks.txt" "36
+17
+f: 2
+g: 1" "--edit-script=tests/test_edit_session.edits"
+run_test "Edit breaking an argument count" "tests/test_multiple_tasks.txt" "Semantic Error Code 4: 8" "--edit-script=tests/test_edit_errors.edits"
+run_test "Typing a declaration" "tests/test_multiple_tasks.txt" "edits: 10 applied, 13 units parsed again, 11 units
+5
+81
+cse: 2 calls, 0 shared
+dce: 1 statements, 1 calls eliminated
+fold: 0 folded, 0 specialized
+Warning Code 2: 9
+f: 2
+g: 1
+h: 4" "--edit-script=tests/test_edit_typing.edits --stats"
+run_test "Edits that end a chain of assignments" "tests/test_task4_multi_useless.txt" "Warning Code 2: 8" "--edit-script=tests/test_edit_liveness.edits"
+run_test "Edit outside the text" "tests/test_task3_output_uninit.txt" "EDIT ERROR: line 1" "--edit-script=tests/test_edit_typing.edits"
+run_differential_tests "Edits that restore the text" "--edit-script=tests/test_edit_restore.edits"
+
+echo ""
+
+# JIT - native code checked against the interpreter on every evaluation
+echo "--- JIT Differential ---"
+run_differential_tests "JIT vs interpreter" "--jit-verify"
+
+echo ""
+
+# Batch - vector kernels checked against the interpreter on random points
+echo "--- Batch Differential ---"
+run_differential_tests "Batch vs scalar" "--batch-verify"
 
 echo ""
 echo "========================================"
@@ -0,0 +1,377 @@
+#include "sparsepoly.h"
+#include <algorithm>
+#include <climits>
+#include <numeric>
+
+using namespace std;
+
+static const int MAX_TERMS = 4096;            // Largest expansion kept
+static const int64_t MAX_PRODUCTS = 1 << 20;  // Term pairs one multiply may form
+static const int64_t MAX_EXP = INT_MAX;       // POW takes an int operand
+
+//---------------------------------------
+// Coefficient Arithmetic
+//---------------------------------------
+
+// Exact coefficients stay in (-2^127, 2^127), so negation cannot overflow;
+// a result outside that range, or one computed from an unknown operand, is
+// unknown.
+static __int128 exactAdd(__int128 a, __int128 b) {
+    __int128 s;
+    if (a == EXACT_UNKNOWN || b == EXACT_UNKNOWN || __builtin_add_overflow(a, b, &s))
+        return EXACT_UNKNOWN;
+    return s;
+}
+
+static __int128 exactNeg(__int128 a) {
+    return a == EXACT_UNKNOWN ? a : -a;
+}
+
+static __int128 exactMul(__int128 a, __int128 b) {
+    __int128 p;
+    if (a == EXACT_UNKNOWN || b == EXACT_UNKNOWN || __builtin_mul_overflow(a, b, &p))
+        return EXACT_UNKNOWN;
+    return p;
+}
+
+template <class T, class Mul>
+static T powBySquaring(T base, int exp, T one, Mul mul) {
+    T res = one;
+    while (exp > 0) {
+        if (exp & 1)
+            res = mul(res, base);
+        base = mul(base, base);
+        exp >>= 1;
+    }
+    return res;
+}
+
+//---------------------------------------
+// Construction and Normal Form
+//---------------------------------------
+SparsePoly SparsePoly::constant(int numVars, __int128 value) {
+    SparsePoly p;
+    p.numVars = numVars;
+    if (value != 0) {
+        p.coeffs.push_back((uint32_t)value);
+        p.exact.push_back(value);
+        p.exps.resize(numVars, 0);
+    }
+    return p;
+}
+
+SparsePoly SparsePoly::variable(int numVars, int index) {
+    SparsePoly p;
+    p.numVars = numVars;
+    p.coeffs.push_back(1);
+    p.exact.push_back(1);
+    p.exps.resize(numVars, 0);
+    p.exps[index] = 1;
+    return p;
+}
+
+// A term whose coefficient is nonzero modulo 2^32 is nonzero over the
+// integers, whether or not its exact coefficient is known.
+int64_t SparsePoly::degree() const {
+    int64_t deg = 0, unknownDeg = -1;
+    for (int t = 0; t < numTerms(); t++) {
+        if (exact[t] == 0)
+            continue;
+        const int64_t *e = termExps(t);
+        int64_t d = accumulate(e, e + numVars, (int64_t)0);
+        if (exact[t] == EXACT_UNKNOWN && coeffs[t] == 0)
+            unknownDeg = max(unknownDeg, d);
+        else
+            deg = max(deg, d);
+    }
+    return unknownDeg > deg ? -1 : deg;
+}
+
+// Orders exponent vectors highest first, parameter 0 most significant.
+static int compareExps(const int64_t *a, const int64_t *b, int n) {
+    for (int i = 0; i < n; i++) {
+        if (a[i] != b[i])
+            return a[i] > b[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+static void appendTerm(SparsePoly &p, uint32_t c, __int128 x, const int64_t *e) {
+    p.coeffs.push_back(c);
+    p.exact.push_back(x);
+    p.exps.insert(p.exps.end(), e, e + p.numVars);
+}
+
+// Sorts the terms and merges like ones, dropping terms that vanish.
+static void normalize(SparsePoly &p) {
+    int n = p.numTerms();
+    vector<int> order(n);
+    iota(order.begin(), order.end(), 0);
+    sort(order.begin(), order.end(), [&](int a, int b) {
+        return compareExps(p.termExps(a), p.termExps(b), p.numVars) < 0;
+    });
+    SparsePoly out;
+    out.numVars = p.numVars;
+    for (int k = 0; k < n; ) {
+        int t = order[k];
+        uint32_t c = 0;
+        __int128 x = 0;
+        int j = k;
+        while (j < n && compareExps(p.termExps(order[j]), p.termExps(t), p.numVars) == 0) {
+            c += p.coeffs[order[j]];
+            x = exactAdd(x, p.exact[order[j]]);
+            j++;
+        }
+        if (x != 0)
+            appendTerm(out, c, x, p.termExps(t));
+        k = j;
+    }
+    p = std::move(out);
+}
+
+//---------------------------------------
+// Polynomial Arithmetic
+//---------------------------------------
+bool sparseAdd(const SparsePoly &a, const SparsePoly &b, int sign, SparsePoly &out) {
+    SparsePoly r;
+    r.numVars = a.numVars;
+    int i = 0, j = 0;
+    while (i < a.numTerms() || j < b.numTerms()) {
+        int cmp;
+        if (i == a.numTerms())
+            cmp = 1;
+        else if (j == b.numTerms())
+            cmp = -1;
+        else
+            cmp = compareExps(a.termExps(i), b.termExps(j), a.numVars);
+        if (cmp < 0) {
+            appendTerm(r, a.coeffs[i], a.exact[i], a.termExps(i));
+            i++;
+        } else {
+            uint32_t c = sign < 0 ? 0u - b.coeffs[j] : b.coeffs[j];
+            __int128 x = sign < 0 ? exactNeg(b.exact[j]) : b.exact[j];
+            const int64_t *e = b.termExps(j);
+            if (cmp == 0) {
+                c += a.coeffs[i];
+                x = exactAdd(x, a.exact[i]);
+                i++;
+            }
+            if (x != 0)
+                appendTerm(r, c, x, e);
+            j++;
+        }
+    }
+    if (r.numTerms() > MAX_TERMS)
+        return false;
+    out = std::move(r);
+    return true;
+}
+
+bool sparseMul(const SparsePoly &a, const SparsePoly &b, SparsePoly &out) {
+    if ((int64_t)a.numTerms() * b.numTerms() > MAX_PRODUCTS)
+        return false;
+    SparsePoly r;
+    r.numVars = a.numVars;
+    vector<int64_t> e(a.numVars);
+    for (int i = 0; i < a.numTerms(); i++) {
+        for (int j = 0; j < b.numTerms(); j++) {
+            for (int v = 0; v < a.numVars; v++) {
+                e[v] = a.termExps(i)[v] + b.termExps(j)[v];
+                if (e[v] > MAX_EXP)
+                    return false;
+            }
+            appendTerm(r, a.coeffs[i] * b.coeffs[j], exactMul(a.exact[i], b.exact[j]), e.data());
+        }
+    }
+    normalize(r);
+    if (r.numTerms() > MAX_TERMS)
+        return false;
+    out = std::move(r);
+    return true;
+}
+
+bool sparsePow(const SparsePoly &a, int exp, SparsePoly &out) {
+    if (exp <= 0) {
+        out = SparsePoly::constant(a.numVars, 1);
+        return true;
+    }
+    if (a.numTerms() <= 1) {
+        // a monomial: raise the coefficient and scale the exponents
+        SparsePoly r = a;
+        for (int t = 0; t < r.numTerms(); t++) {
+            r.coeffs[t] = powBySquaring<uint32_t>(r.coeffs[t], exp, 1u,
+                [](uint32_t x, uint32_t y) { return x * y; });
+            r.exact[t] = powBySquaring<__int128>(r.exact[t], exp, 1, exactMul);
+            for (int v = 0; v < r.numVars; v++) {
+                int64_t &e = r.exps[(size_t)t * r.numVars + v];
+                if (e != 0 && e > MAX_EXP / exp)
+                    return false;
+                e *= exp;
+            }
+        }
+        normalize(r);
+        out = std::move(r);
+        return true;
+    }
+    if (exp > MAX_TERMS)
+        return false;           // at least exp + 1 terms
+    SparsePoly res = SparsePoly::constant(a.numVars, 1);
+    SparsePoly base = a;
+    while (exp > 0) {
+        if ((exp & 1) && !sparseMul(res, base, res))
+            return false;
+        exp >>= 1;
+        if (exp > 0 && !sparseMul(base, base, base))
+            return false;
+    }
+    out = std::move(res);
+    return true;
+}
+
+void sparseSubstitute(const SparsePoly &p, const vector<char> &isConst,
+                      const vector<int> &values, SparsePoly &out) {
+    int numLeft = 0;
+    vector<int> newIndex(p.numVars, -1);
+    for (int v = 0; v < p.numVars; v++) {
+        if (!isConst[v])
+            newIndex[v] = numLeft++;
+    }
+    SparsePoly r;
+    r.numVars = numLeft;
+    vector<int64_t> e(numLeft);
+    for (int t = 0; t < p.numTerms(); t++) {
+        uint32_t c = p.coeffs[t];
+        __int128 x = p.exact[t];
+        const int64_t *te = p.termExps(t);
+        for (int v = 0; v < p.numVars; v++) {
+            if (!isConst[v]) {
+                e[newIndex[v]] = te[v];
+                continue;
+            }
+            c *= powBySquaring<uint32_t>((uint32_t)values[v], (int)te[v], 1u,
+                [](uint32_t a, uint32_t b) { return a * b; });
+            x = exactMul(x, powBySquaring<__int128>(values[v], (int)te[v], 1, exactMul));
+        }
+        appendTerm(r, c, x, e.data());
+    }
+    normalize(r);
+    out = std::move(r);
+}
+
+//---------------------------------------
+// Horner Code Generation
+//---------------------------------------
+
+// Expression nodes built before emission so that multiplications by one
+// and additions of zero disappear.
+namespace {
+struct HNode {
+    OpCode op;
+    int operand;
+    int left = -1, right = -1;
+};
+
+class HornerBuilder {
+public:
+    HornerBuilder(const SparsePoly &p) : p(p) {}
+
+    int build(int lo, int hi, int var);
+    void emit(int root, PolyCode &pc) const;
+
+private:
+    const SparsePoly &p;
+    std::vector<HNode> nodes;
+
+    int node(OpCode op, int operand, int left = -1, int right = -1) {
+        nodes.push_back(HNode{op, operand, left, right});
+        return (int)nodes.size() - 1;
+    }
+    bool isConst(int n, int value) const {
+        return nodes[n].op == OpCode::LOAD_CONST && nodes[n].operand == value;
+    }
+    int mul(int a, int b) {
+        if (isConst(a, 1)) return b;
+        if (isConst(b, 1)) return a;
+        return node(OpCode::MUL, 0, a, b);
+    }
+    int add(int a, int b) {
+        if (isConst(a, 0)) return b;
+        if (isConst(b, 0)) return a;
+        return node(OpCode::ADD, 0, a, b);
+    }
+    int power(int var, int64_t e) {
+        if (e == 0)
+            return node(OpCode::LOAD_CONST, 1);
+        int x = node(OpCode::LOAD_PARAM, var);
+        return e == 1 ? x : node(OpCode::POW, (int)e, x);
+    }
+};
+
+// Terms lo..hi-1 agree on the exponents of parameters before var, so they
+// are grouped by the exponent of var, highest first.
+int HornerBuilder::build(int lo, int hi, int var) {
+    if (var == p.numVars)
+        return node(OpCode::LOAD_CONST, (int)p.coeffs[lo]);
+    int acc = -1;
+    int64_t prevExp = 0;
+    for (int i = lo; i < hi; ) {
+        int64_t e = p.termExps(i)[var];
+        int j = i;
+        while (j < hi && p.termExps(j)[var] == e)
+            j++;
+        int coeff = build(i, j, var + 1);
+        acc = (acc < 0) ? coeff : add(mul(acc, power(var, prevExp - e)), coeff);
+        prevExp = e;
+        i = j;
+    }
+    return mul(acc, power(var, prevExp));
+}
+
+// Postorder emission with an explicit stack.
+void HornerBuilder::emit(int root, PolyCode &pc) const {
+    std::vector<std::pair<int, bool>> stack;
+    stack.push_back({root, false});
+    while (!stack.empty()) {
+        auto [n, expanded] = stack.back();
+        stack.pop_back();
+        const HNode &h = nodes[n];
+        if (expanded || h.left < 0) {
+            pc.emit(h.op, h.operand);
+            continue;
+        }
+        stack.push_back({n, true});
+        if (h.right >= 0)
+            stack.push_back({h.right, false});
+        stack.push_back({h.left, false});
+    }
+}
+}
+
+void emitHorner(const SparsePoly &p, PolyCode &pc) {
+    // terms that vanish modulo 2^32 do not affect the value
+    SparsePoly live;
+    live.numVars = p.numVars;
+    for (int t = 0; t < p.numTerms(); t++) {
+        if (p.coeffs[t] != 0)
+            appendTerm(live, p.coeffs[t], p.exact[t], p.termExps(t));
+    }
+    if (live.numTerms() == 0) {
+        pc.emit(OpCode::LOAD_CONST, 0);
+        return;
+    }
+    HornerBuilder hb(live);
+    int root = hb.build(0, live.numTerms(), 0);
+    hb.emit(root, pc);
+}
+
+int countMultiplies(const PolyCode &pc) {
+    int count = 0;
+    for (const Instr &in : pc.code) {
+        if (in.op == OpCode::MUL)
+            count++;
+        else if (in.op == OpCode::POW && in.operand > 1)
+            count += (31 - __builtin_clz((unsigned)in.operand)) +
+                     __builtin_popcount((unsigned)in.operand) - 1;
+    }
+    return count;
+}
@@ -0,0 +1,61 @@
+#ifndef SPARSEPOLY_H
+#define SPARSEPOLY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "polyvm.h"
+
+///---------------------------------------------------------
+/// Canonical Sparse Polynomials (Tasks 2 & 5)
+///---------------------------------------------------------
+
+/// Marks an exact coefficient that overflowed 128 bits.
+const __int128 EXACT_UNKNOWN = (__int128)((unsigned __int128)1 << 127);
+
+/// A polynomial over numVars parameters as a list of terms, each a
+/// coefficient and an exponent vector, kept sorted by exponent vector
+/// (parameter 0 most significant, highest first) with like terms merged.
+///
+/// Every coefficient is tracked twice: modulo 2^32, which is what wrapping
+/// int evaluation computes, and exactly as a 128-bit integer, which tells a
+/// term that cancelled over the integers from one that merely wrapped. An
+/// exact coefficient that would not fit is marked unknown from then on.
+struct SparsePoly {
+    int numVars = 0;
+    std::vector<uint32_t> coeffs;     // Coefficient modulo 2^32
+    std::vector<__int128> exact;      // Coefficient, or EXACT_UNKNOWN
+    std::vector<int64_t> exps;        // numVars exponents per term
+
+    int numTerms() const { return (int)coeffs.size(); }
+    const int64_t *termExps(int t) const { return &exps[(std::size_t)t * numVars]; }
+
+    static SparsePoly constant(int numVars, __int128 value);
+    static SparsePoly variable(int numVars, int index);
+
+    /// Degree of the terms that are nonzero over the integers, or -1 when
+    /// it depends on a term whose exact coefficient is unknown.
+    int64_t degree() const;
+};
+
+/// Arithmetic on canonical polynomials. Each returns false, leaving out
+/// unspecified, when the result would exceed the term or exponent limits.
+bool sparseAdd(const SparsePoly &a, const SparsePoly &b, int sign, SparsePoly &out);
+bool sparseMul(const SparsePoly &a, const SparsePoly &b, SparsePoly &out);
+bool sparsePow(const SparsePoly &a, int exp, SparsePoly &out);
+
+/// Replaces the parameters marked in isConst by values and renumbers the
+/// others in order. The number of terms can only shrink.
+void sparseSubstitute(const SparsePoly &p, const std::vector<char> &isConst,
+                      const std::vector<int> &values, SparsePoly &out);
+
+/// Emits code evaluating p with a multivariate Horner scheme: p is written
+/// as a polynomial in parameter 0 whose coefficients are polynomials in the
+/// remaining parameters, and each level is evaluated by nested Horner steps.
+void emitHorner(const SparsePoly &p, PolyCode &pc);
+
+/// Number of multiplications the code performs, counting POW as the
+/// multiplications done by repeated squaring.
+int countMultiplies(const PolyCode &pc);
+
+#endif
@@ -0,0 +1,188 @@
+#include "threadpool.h"
+
+#include <deque>
+#include <memory>
+
+using namespace std;
+
+ThreadPool::ThreadPool(int threads) {
+    for (int i = 1; i < threads; i++)
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lock(poolMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (thread &t : workers)
+        t.join();
+}
+
+int ThreadPool::hardwareThreads() {
+    unsigned n = thread::hardware_concurrency();
+    return n > 0 ? (int)n : 1;
+}
+
+void ThreadPool::run(size_t n, const function<void(size_t)> &f) {
+    {
+        lock_guard<mutex> lock(poolMutex);
+        task = &f;
+        count = n;
+        next.store(0);
+        busy = (int)workers.size();
+        generation++;
+    }
+    wake.notify_all();
+    work();
+    unique_lock<mutex> lock(poolMutex);
+    finished.wait(lock, [this] { return busy == 0; });
+    task = nullptr;
+    exception_ptr error = move(failure);
+    failure = nullptr;
+    lock.unlock();
+    if (error)
+        rethrow_exception(error);
+}
+
+// Workers sleep between runs and join each run at most once.
+void ThreadPool::workerLoop() {
+    uint64_t seen = 0;
+    for (;;) {
+        {
+            unique_lock<mutex> lock(poolMutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+        work();
+        lock_guard<mutex> lock(poolMutex);
+        if (--busy == 0)
+            finished.notify_one();
+    }
+}
+
+void ThreadPool::work() {
+    for (size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+        try {
+            (*task)(i);
+        } catch (...) {
+            lock_guard<mutex> lock(poolMutex);
+            if (!failure)
+                failure = current_exception();
+            next.store(count);
+        }
+    }
+}
+
+// Ready nodes of one thread. The owner pushes and pops at the back,
+// thieves take from the front.
+struct alignas(64) ReadyQueue {
+    std::mutex lock;
+    std::deque<int> nodes;
+};
+
+void TaskGraph::run(ThreadPool &pool, const function<void(int, int)> &task) {
+    vector<int> first(numNodes + 1, 0);         // Successors of i are succ[first[i] .. first[i+1])
+    for (auto &e : edges)
+        first[e.first + 1]++;
+    for (int i = 0; i < numNodes; i++)
+        first[i + 1] += first[i];
+    vector<int> succ(edges.size()), fill(first.begin(), first.end() - 1);
+    unique_ptr<atomic<int>[]> pending(new atomic<int>[numNodes]);
+    for (int i = 0; i < numNodes; i++)
+        pending[i].store(0, memory_order_relaxed);
+    for (auto &e : edges) {
+        succ[fill[e.first]++] = e.second;
+        pending[e.second].fetch_add(1, memory_order_relaxed);
+    }
+
+    int threads = pool.size();
+    unique_ptr<ReadyQueue[]> queues(new ReadyQueue[threads]);
+    int next = 0;
+    for (int i = 0; i < numNodes; i++) {
+        if (pending[i].load(memory_order_relaxed) == 0)
+            queues[next++ % threads].nodes.push_back(i);
+    }
+
+    auto take = [&](int self, int &node) {
+        for (int k = 0; k < threads; k++) {
+            ReadyQueue &q = queues[(self + k) % threads];
+            lock_guard<mutex> guard(q.lock);
+            if (q.nodes.empty())
+                continue;
+            if (k == 0) {
+                node = q.nodes.back();
+                q.nodes.pop_back();
+            } else {
+                node = q.nodes.front();
+                q.nodes.pop_front();
+            }
+            return true;
+        }
+        return false;
+    };
+
+    // Threads that find no ready node park on idle until a node is queued
+    // or the graph is done. The counts are sequentially consistent: a
+    // thread about to park counts itself in sleepers before checking
+    // readyCount, and a producer counts the node before checking sleepers,
+    // so one of them always sees the other and no wakeup is lost. The last
+    // task's decrement of remaining pairs with sleepers the same way.
+    atomic<int> remaining(numNodes);
+    atomic<int> readyCount(0);
+    atomic<int> sleepers(0);
+    mutex idleMutex;
+    condition_variable idle;
+    exception_ptr failure;                      // First exception of a task
+    mutex failureMutex;
+    for (int i = 0; i < threads; i++)
+        readyCount.fetch_add((int)queues[i].nodes.size(), memory_order_relaxed);
+
+    auto wakeIdle = [&](bool all) {
+        if (sleepers.load() == 0)
+            return;
+        lock_guard<mutex> guard(idleMutex);
+        if (all)
+            idle.notify_all();
+        else
+            idle.notify_one();
+    };
+
+    pool.run(threads, [&](size_t t) {
+        int self = (int)t, node;
+        while (remaining.load(memory_order_acquire) > 0) {
+            if (!take(self, node)) {
+                unique_lock<mutex> lock(idleMutex);
+                sleepers.fetch_add(1);
+                idle.wait(lock, [&] { return readyCount.load() > 0 || remaining.load() == 0; });
+                sleepers.fetch_sub(1);
+                continue;
+            }
+            readyCount.fetch_sub(1);
+            try {
+                task(node, self);
+            } catch (...) {
+                lock_guard<mutex> guard(failureMutex);
+                if (!failure)
+                    failure = current_exception();
+            }
+            for (int s = first[node]; s < first[node + 1]; s++) {
+                if (pending[succ[s]].fetch_sub(1, memory_order_acq_rel) == 1) {
+                    {
+                        lock_guard<mutex> guard(queues[self].lock);
+                        queues[self].nodes.push_back(succ[s]);
+                    }
+                    readyCount.fetch_add(1);
+                    wakeIdle(false);
+                }
+            }
+            if (remaining.fetch_sub(1) == 1)
+                wakeIdle(true);
+        }
+    });
+    if (failure)
+        rethrow_exception(failure);
+}
@@ -0,0 +1,86 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+///---------------------------------------------------------
+/// Thread Pool
+///---------------------------------------------------------
+
+/// A fixed set of threads that run the indices of a task in parallel. The
+/// calling thread takes part in every run, so a pool of n threads starts
+/// n - 1 workers. If a task throws, the indices not yet handed out are
+/// skipped and run() rethrows the first exception on the calling thread.
+class ThreadPool {
+public:
+    explicit ThreadPool(int threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /// Threads taking part in a run, the caller included.
+    int size() const { return (int)workers.size() + 1; }
+
+    /// Calls task(i) once for every i in [0, count), handing indices out in
+    /// increasing order, and returns when all calls have finished. Throws
+    /// what the first failing call threw.
+    void run(size_t count, const std::function<void(size_t)> &task);
+
+    /// The number of hardware threads, at least 1.
+    static int hardwareThreads();
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex poolMutex;
+    std::condition_variable wake;     // A run started or the pool is stopping
+    std::condition_variable finished; // The last worker left a run
+    const std::function<void(size_t)> *task = nullptr;
+    size_t count = 0;
+    std::atomic<size_t> next{0};      // Next index to hand out
+    uint64_t generation = 0;          // Runs started so far
+    int busy = 0;                     // Workers still in the current run
+    bool stopping = false;
+    std::exception_ptr failure;       // First exception of the current run
+
+    void workerLoop();
+    void work();
+};
+
+///---------------------------------------------------------
+/// Dependency Graph Scheduling
+///---------------------------------------------------------
+
+/// Nodes numbered 0 .. n-1 with edges from each node to the nodes that
+/// must wait for it. run() starts a node once all its predecessors have
+/// finished. Every thread keeps the nodes it made ready in its own queue
+/// and takes the newest one first; a thread whose queue is empty steals the
+/// oldest node of another thread.
+class TaskGraph {
+public:
+    explicit TaskGraph(int numNodes) : numNodes(numNodes) {}
+
+    /// to may only start after from has finished.
+    void addEdge(int from, int to) { edges.push_back({from, to}); }
+
+    /// Calls task(node, thread) once for every node, where thread is below
+    /// pool.size() and no two calls running at the same time share it. A
+    /// node whose task throws still releases its successors; run() then
+    /// rethrows the first exception once the graph is done.
+    void run(ThreadPool &pool, const std::function<void(int, int)> &task);
+
+private:
+    int numNodes;
+    std::vector<std::pair<int, int>> edges;
+};
+
+#endif